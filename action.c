@@ -1,7 +1,11 @@
+#define _GNU_SOURCE
 #include <vte/vte.h>
 #include <gtk/gtk.h>
 #include <gdk/gdkx.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "action.h"
 #include "window.h"
 #include "terminal.h"
@@ -9,8 +13,27 @@
 #include "split.h"
 #include "utils.h"
 #include "search_bar.h"
+#include "socket.h"
+#include "regex_cache.h"
+#include "search_all.h"
+#include "output_match.h"
+#include "scrollback_log.h"
+#include "recording.h"
+#include "prompt_marks.h"
+#include "plugin.h"
+#include "scheduler.h"
+#include "layout.h"
+#include "memory.h"
+
+#define SNAPSHOT_CHILD_FD 3
 
 GHashTable* actions = NULL;
+// snapshot to be sent back over the socket, if any
+int pending_snapshot_fd = -1;
+// whoever is waiting on the result of the current action, if they can wait
+DeferredResultFunc result_handler = NULL;
+gpointer result_handler_data = NULL;
+gboolean result_deferred = FALSE;
 
 GtkWidget* detaching_tab = NULL;
 VteTerminal* detaching_terminal = NULL;
@@ -65,6 +88,8 @@ void change_font_scale(VteTerminal* terminal, char* delta) {
 
 void reset_terminal(VteTerminal* terminal) {
     vte_terminal_reset(terminal, 1, 1);
+    term_reset_committed_rows(terminal);
+    prompt_marks_reset(terminal);
     vte_terminal_feed_child_binary(terminal, (guint8*)"\x0c", 1); // control-l = clear
 }
 
@@ -117,11 +142,18 @@ GtkWidget* new_term(gchar* data, char** size, int** pipes) {
         return NULL;
     }
 
+    char* replay = NULL;
+    double replay_speed = 1;
+
     original = argv;
     while (argc > 0) {
         char* tmp;
         if ((tmp = STR_STRIP_PREFIX(argv[0], "cwd="))) {
             cwd = tmp;
+        } else if ((tmp = STR_STRIP_PREFIX(argv[0], "replay="))) {
+            replay = tmp;
+        } else if ((tmp = STR_STRIP_PREFIX(argv[0], "replay-speed="))) {
+            replay_speed = g_ascii_strtod(tmp, NULL);
         } else if ((tmp = STR_STRIP_PREFIX(argv[0], "size="))) {
             if (size) *size = strdup(tmp);
         } else {
@@ -132,6 +164,13 @@ GtkWidget* new_term(gchar* data, char** size, int** pipes) {
         argv ++;
     }
 
+    // don't let a shell prompt get mixed in with the replay
+    char* replay_argv[] = {"cat", NULL};
+    if (replay && argc == 0) {
+        argc = 1;
+        argv = replay_argv;
+    }
+
     GtkWidget* grid = NULL;
     if (pipes == NULL || *pipes == NULL) {
         grid = make_terminal(cwd, argc, argv);
@@ -158,6 +197,10 @@ GtkWidget* new_term(gchar* data, char** size, int** pipes) {
         }
     }
 
+    if (grid && replay) {
+        replay_start(g_object_get_data(G_OBJECT(grid), "terminal"), replay, replay_speed);
+    }
+
     if (original) g_strfreev(original);
     return grid;
 }
@@ -174,6 +217,12 @@ GtkWidget* new_window(VteTerminal* terminal, char* data, int** pipes) {
     return widget;
 }
 
+void layout(VteTerminal* terminal, char* data, char** result) {
+    if (! data) return;
+    // the timings are only known once the window has painted, so they come later
+    layout_build(data, result != NULL);
+}
+
 void on_split_resize(GtkWidget* paned, GdkRectangle *rect, int value) {
     gtk_paned_set_position(GTK_PANED(paned), value);
     g_signal_handlers_disconnect_by_func(paned, on_split_resize, GINT_TO_POINTER(value));
@@ -447,24 +496,42 @@ void load_file(VteTerminal* terminal, char* filename) {
     }
 }
 
+void subprocess_track(VteTerminal* terminal, int delta, gsize stdin_size) {
+    // pending subprocesses and the stdin they hold on to, for memory_stats
+    guint count = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(terminal), "subprocesses"));
+    gsize bytes = GPOINTER_TO_SIZE(g_object_get_data(G_OBJECT(terminal), "subprocess-bytes"));
+    g_object_set_data(G_OBJECT(terminal), "subprocesses", GUINT_TO_POINTER(count + delta));
+    g_object_set_data(G_OBJECT(terminal), "subprocess-bytes", GSIZE_TO_POINTER(delta > 0 ? bytes + stdin_size : bytes - stdin_size));
+}
+
 void subprocess_finish(GObject* proc, GAsyncResult* res, void* data) {
     GError* error = NULL;
     GBytes* stdout_buf;
+    VteTerminal* terminal = g_object_get_data(proc, "terminal");
+    subprocess_track(terminal, -1, GPOINTER_TO_SIZE(g_object_get_data(proc, "stdin-size")));
+
     if (! g_subprocess_communicate_finish(G_SUBPROCESS(proc), res, &stdout_buf, NULL, &error)) {
         if (error->domain != G_IO_ERROR || error->code != G_IO_ERROR_BROKEN_PIPE) {
             g_warning("IO failed (%s): %s", error->message, data ? (char*)data : "");
         }
         g_error_free(error);
+        free(data);
         return;
     }
 
     gsize size;
     const char* buf_data = g_bytes_get_data(stdout_buf, &size);
-    VteTerminal* terminal = g_object_get_data(proc, "terminal");
     vte_terminal_feed_child_binary(terminal, (guint8*)buf_data, size);
+    g_bytes_unref(stdout_buf);
+    free(data);
+
+    if (size + GPOINTER_TO_SIZE(g_object_get_data(proc, "stdin-size")) >= MEMORY_RECLAIM_LARGE_EXPORT) {
+        memory_reclaim_later();
+    }
 }
 
-void spawn_subprocess(VteTerminal* terminal, gchar* data_, char* text, char** result) {
+void spawn_subprocess_full(VteTerminal* terminal, gchar* data_, char* text, char** result, GSubprocessLauncher* launcher) {
+    // takes ownership of launcher, if given
     gint argc;
     char* data = data_ ? strdup(data_) : NULL;
     char** argv = shell_split(data, &argc);
@@ -474,6 +541,8 @@ void spawn_subprocess(VteTerminal* terminal, gchar* data_, char* text, char** re
             // put in result instead
             *result = text;
         }
+        if (launcher) g_object_unref(launcher);
+        free(data);
         return;
     }
 
@@ -483,7 +552,11 @@ void spawn_subprocess(VteTerminal* terminal, gchar* data_, char* text, char** re
     }
 
     GError* error = NULL;
-    GSubprocessLauncher* launcher = g_subprocess_launcher_new(flags);
+    if (launcher) {
+        g_subprocess_launcher_set_flags(launcher, flags);
+    } else {
+        launcher = g_subprocess_launcher_new(flags);
+    }
 
     char buffer[1024];
     glong cursorx, cursory;
@@ -521,6 +594,8 @@ void spawn_subprocess(VteTerminal* terminal, gchar* data_, char* text, char** re
     FMT_ENVIRON(ROWS, "%li", vte_terminal_get_row_count(terminal));
     /* TODO TERM? */
     if (hyperlink) SET_ENVIRON(HYPERLINK, hyperlink);
+    g_free(hyperlink);
+    if (output_match_text) SET_ENVIRON(MATCH, output_match_text);
 
     // get x11 windowid
 #ifdef GDK_WINDOWING_X11
@@ -535,16 +610,30 @@ void spawn_subprocess(VteTerminal* terminal, gchar* data_, char* text, char** re
     freeproc(fgproc);
 
     GSubprocess* proc = g_subprocess_launcher_spawnv(launcher, (const char**)argv, &error);
+    g_object_unref(launcher);
+    g_strfreev(argv);
     if (!proc) {
         g_warning("Failed to run (%s): %s", error->message, data);
         g_error_free(error);
+        free(data);
         return;
     }
 
-    g_object_set_data(G_OBJECT(proc), "terminal", g_object_ref(terminal));
+    g_object_set_data_full(G_OBJECT(proc), "terminal", g_object_ref(terminal), g_object_unref);
 
     GBytes* stdin_bytes = text ? g_bytes_new_take(text, strlen(text)) : NULL;
+    gsize stdin_size = stdin_bytes ? g_bytes_get_size(stdin_bytes) : 0;
+    g_object_set_data(G_OBJECT(proc), "stdin-size", GSIZE_TO_POINTER(stdin_size));
+    subprocess_track(terminal, 1, stdin_size);
+
+    // the async operation keeps its own references
     g_subprocess_communicate_async(proc, stdin_bytes, NULL, subprocess_finish, data);
+    if (stdin_bytes) g_bytes_unref(stdin_bytes);
+    g_object_unref(proc);
+}
+
+void spawn_subprocess(VteTerminal* terminal, gchar* data, char* text, char** result) {
+    spawn_subprocess_full(terminal, data, text, result, NULL);
 }
 
 void run(VteTerminal* terminal, char* data) {
@@ -579,6 +668,337 @@ void pipe_all_ansi(VteTerminal* terminal, char* data, char** result) {
     spawn_subprocess(terminal, data, text, result);
 }
 
+char* parse_row_range(VteTerminal* terminal, char* data, glong* start, glong* end) {
+    /*
+     * START,END[ rest]
+     * rows count from the top of the scrollback, negative values count from the bottom
+     * END is inclusive
+     * returns the rest of the string or NULL if invalid
+     */
+    if (! data) return NULL;
+
+    int lower, upper;
+    term_get_row_positions(terminal, NULL, NULL, &lower, &upper);
+
+    char* string = data;
+    *start = strtol(string, &string, 10);
+    if (*string != ',') return NULL;
+    *end = strtol(string+1, &string, 10);
+    if (*string && ! g_ascii_isspace(*string)) return NULL;
+
+    *start += *start < 0 ? upper : lower;
+    *end += *end < 0 ? upper : lower;
+    *start = MAX(*start, lower);
+    *end = MIN(*end, upper - 1);
+
+    while (g_ascii_isspace(*string)) string++;
+    return string;
+}
+
+void do_pipe_rows(VteTerminal* terminal, char* data, char** result, gboolean ansi) {
+    glong start, end;
+    char* command = parse_row_range(terminal, data, &start, &end);
+    if (! command) {
+        g_warning("Invalid row range: %s", data ? data : "");
+        return;
+    }
+
+    char* text = start <= end ? term_get_text(terminal, start, 0, end+1, -1, ansi) : strdup("");
+    spawn_subprocess(terminal, command, text, result);
+}
+
+void pipe_rows(VteTerminal* terminal, char* data, char** result) {
+    do_pipe_rows(terminal, data, result, FALSE);
+}
+
+void pipe_rows_ansi(VteTerminal* terminal, char* data, char** result) {
+    do_pipe_rows(terminal, data, result, TRUE);
+}
+
+void pipe_since(VteTerminal* terminal, char* data, char** result) {
+    /*
+     * [name=NAME |token=ROW ][command]
+     * export rows that were completed since the last call
+     * the cursor row is still being written to so is left for next time
+     *
+     * by default where the last call got to is kept per terminal (and per name),
+     * and rebased on reset/rewrap like the other committed row watermarks
+     * with token=, the caller keeps track of it instead
+     */
+    char* name = "";
+    char* token_arg = NULL;
+    char* command = data;
+    char* tmp;
+    if (data && ((tmp = STR_STRIP_PREFIX(data, "name=")) || (tmp = STR_STRIP_PREFIX(data, "token=")))) {
+        if (*data == 'n') {
+            name = tmp;
+        } else {
+            token_arg = tmp;
+        }
+        command = tmp + strcspn(tmp, " \t");
+        if (*command) {
+            *command = '\0';
+            command ++;
+            while (g_ascii_isspace(*command)) command++;
+        }
+    }
+
+    int lower, upper;
+    glong column, cursor;
+    term_get_row_positions(terminal, NULL, NULL, &lower, &upper);
+    vte_terminal_get_cursor_position(terminal, &column, &cursor);
+
+    glong start = cursor, end = cursor;
+    if (token_arg) {
+        char* token_end;
+        start = strtol(token_arg, &token_end, 10);
+        // invalid, expired or from before a reset
+        if (token_end == token_arg || *token_end || start < lower || start > cursor) {
+            start = lower;
+        }
+    } else {
+        char* key = g_strconcat("pipe-since:", name, NULL);
+        if (! term_get_committed_rows(terminal, key, &start, &end)) {
+            start = end = cursor;
+        }
+        free(key);
+    }
+
+    char* text = start < end ? term_get_text(terminal, start, 0, end, -1, FALSE) : strdup("");
+    char token[32];
+    snprintf(token, sizeof(token), "%li", end);
+
+    if (command && *command) {
+        GSubprocessLauncher* launcher = g_subprocess_launcher_new(G_SUBPROCESS_FLAGS_NONE);
+        g_subprocess_launcher_setenv(launcher, APP_PREFIX "_TOKEN", token, TRUE);
+        spawn_subprocess_full(terminal, command, text, result, launcher);
+    } else if (result && token_arg) {
+        // token on the first line
+        *result = g_strconcat(token, "\n", text, NULL);
+        free(text);
+    } else if (result) {
+        *result = text;
+    } else {
+        free(text);
+    }
+}
+
+void jump_prompt(VteTerminal* terminal, int direction) {
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal));
+    glong row = prompt_marks_find(terminal, gtk_adjustment_get_value(adj), direction);
+    if (row >= 0) {
+        gtk_adjustment_set_value(adj, row);
+    }
+}
+
+void jump_prev_prompt(VteTerminal* terminal) {
+    jump_prompt(terminal, -1);
+}
+
+void jump_next_prompt(VteTerminal* terminal) {
+    jump_prompt(terminal, 1);
+}
+
+void pipe_last_output(VteTerminal* terminal, char* data, char** result) {
+    CommandMark* mark = prompt_marks_last_output(terminal);
+    char* text = mark && mark->output_row < mark->end_row ? term_get_text(terminal, mark->output_row, 0, mark->end_row, -1, FALSE) : strdup("");
+    spawn_subprocess(terminal, data, text, result);
+}
+
+void select_last_output(VteTerminal* terminal) {
+    CommandMark* mark = prompt_marks_last_output(terminal);
+    if (mark && mark->output_row < mark->end_row) {
+        int lower;
+        term_get_row_positions(terminal, NULL, NULL, &lower, NULL);
+        term_select_range(terminal, 0, mark->output_row - lower, -1, mark->end_row - 1 - lower, 0, FALSE);
+    }
+}
+
+void record_rows(VteTerminal* terminal, char* data) {
+    // no file stops recording
+    if (data && *data) {
+        record_start(terminal, data);
+    } else {
+        record_stop(terminal);
+    }
+}
+
+void replay(VteTerminal* terminal, char* data) {
+    // [speed=N ]FILE
+    double speed = 1;
+    char* tmp;
+    if (data && (tmp = STR_STRIP_PREFIX(data, "speed="))) {
+        speed = g_ascii_strtod(tmp, &data);
+        while (g_ascii_isspace(*data)) data++;
+    }
+    if (data && *data) {
+        replay_start(terminal, data, speed);
+    }
+}
+
+void log_search(VteTerminal* terminal, char* data, char** result) {
+    int count;
+    char* output = scrollback_log_search(terminal, data, &count);
+    if (result) {
+        *result = output;
+    } else {
+        char message[64];
+        snprintf(message, sizeof(message), "%i matches in log", count);
+        term_show_message_bar(terminal, message, 2000);
+        free(output);
+    }
+}
+
+void log_export(VteTerminal* terminal, char* data, char** result) {
+    /*
+     * START,END[ command]
+     * lines count from the start of the log, negative values count from the end
+     * END is inclusive
+     */
+    char* command = data;
+    gint64 start = 0, end = 0;
+    if (data) {
+        start = g_ascii_strtoll(data, &command, 10);
+        if (*command == ',') {
+            end = g_ascii_strtoll(command+1, &command, 10);
+        } else {
+            command = NULL;
+        }
+    }
+    if (! command || (*command && ! g_ascii_isspace(*command))) {
+        g_warning("Invalid line range: %s", data ? data : "");
+        return;
+    }
+    while (g_ascii_isspace(*command)) command++;
+
+    gint64 lines = scrollback_log_line_count(terminal);
+    if (start < 0) start += lines;
+    if (end < 0) end += lines;
+    start = MAX(start, 0);
+    end = MIN(end, lines - 1);
+
+    char* text = start <= end ? scrollback_log_export(terminal, start, end+1) : NULL;
+    spawn_subprocess(terminal, command, text ? text : strdup(""), result);
+}
+
+int snapshot_to_memfd(char* text) {
+    // takes ownership of text, returns a sealed read-only fd
+    if (! text) return -1;
+
+    int fd = memfd_create(APP_PREFIX_LOWER "-snapshot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        g_warning("Failed to create memfd: %s", strerror(errno));
+        free(text);
+        return -1;
+    }
+
+    int result = write_to_fd(fd, text, strlen(text));
+    free(text);
+    if (result < 0 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+        if (result >= 0) g_warning("Failed to seal memfd: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+int take_pending_snapshot_fd() {
+    int fd = pending_snapshot_fd;
+    pending_snapshot_fd = -1;
+    return fd;
+}
+
+char* execute_line_deferred(char* line, int size, DeferredResultFunc func, gpointer data, gboolean* deferred) {
+    /*
+     * execute_line, but actions that finish later can call func with their result instead
+     * sets *deferred if they will, and then the return value is meaningless
+     */
+    DeferredResultFunc outer_func = result_handler;
+    gpointer outer_data = result_handler_data;
+    gboolean outer_deferred = result_deferred;
+
+    result_handler = func;
+    result_handler_data = data;
+    result_deferred = FALSE;
+    char* result = execute_line(line, size, TRUE, TRUE);
+    *deferred = result_deferred;
+
+    result_handler = outer_func;
+    result_handler_data = outer_data;
+    result_deferred = outer_deferred;
+
+    if (*deferred) {
+        free(result);
+        result = NULL;
+    }
+    return result;
+}
+
+DeferredResult* defer_action_result() {
+    /*
+     * for actions that finish later, the result gets passed to deferred_result_return instead
+     * NULL if there is no one to hand it to
+     */
+    if (! result_handler) return NULL;
+    DeferredResult* deferred = malloc(sizeof(DeferredResult));
+    deferred->func = result_handler;
+    deferred->data = result_handler_data;
+    result_deferred = TRUE;
+    return deferred;
+}
+
+void deferred_result_return(DeferredResult* deferred, char* result) {
+    // takes ownership of result
+    deferred->func(result, deferred->data);
+    free(deferred);
+}
+
+void do_pipe_snapshot(VteTerminal* terminal, char* data, char** result, gboolean ansi) {
+    /*
+     * write the text once into a sealed memfd
+     * and hand that to the child (or over the socket) instead of piping it
+     */
+    int upper, lower;
+    term_get_row_positions(terminal, NULL, NULL, &lower, &upper);
+    int fd = snapshot_to_memfd(term_get_text(terminal, lower, 0, upper, -1, ansi));
+    if (fd < 0) return;
+
+    struct stat st;
+    off_t size = fstat(fd, &st) == 0 ? st.st_size : 0;
+    if (size >= MEMORY_RECLAIM_LARGE_EXPORT) memory_reclaim_later();
+
+    gint argc = 0;
+    char** argv = shell_split(data, &argc);
+    g_strfreev(argv);
+
+    if (argc > 0) {
+        char buffer[16];
+        GSubprocessLauncher* launcher = g_subprocess_launcher_new(G_SUBPROCESS_FLAGS_NONE);
+        g_subprocess_launcher_take_fd(launcher, fd, SNAPSHOT_CHILD_FD);
+        snprintf(buffer, sizeof(buffer), "%i", SNAPSHOT_CHILD_FD);
+        g_subprocess_launcher_setenv(launcher, APP_PREFIX "_SNAPSHOT_FD", buffer, TRUE);
+        spawn_subprocess_full(terminal, data, NULL, NULL, launcher);
+
+    } else if (result) {
+        // reply with the size, the server attaches the fd
+        *result = g_strdup_printf("%li", (long)size);
+        if (pending_snapshot_fd >= 0) close(pending_snapshot_fd);
+        pending_snapshot_fd = fd;
+
+    } else {
+        close(fd);
+    }
+}
+
+void pipe_all_snapshot(VteTerminal* terminal, char* data, char** result) {
+    do_pipe_snapshot(terminal, data, result, FALSE);
+}
+
+void pipe_all_snapshot_ansi(VteTerminal* terminal, char* data, char** result) {
+    do_pipe_snapshot(terminal, data, result, TRUE);
+}
+
 void move_split_right(VteTerminal* terminal) {
     split_move(term_get_grid(terminal), GTK_ORIENTATION_HORIZONTAL, TRUE);
     term_set_focus(terminal, TRUE);
@@ -720,6 +1140,49 @@ void search(VteTerminal* terminal, char* data, char** result) {
     SEARCH(0);
 }
 
+typedef struct {
+    VteTerminal* terminal;
+    DeferredResult* deferred;
+} SearchAllRequest;
+
+void search_all_done(char* output, int count, SearchAllRequest* request) {
+    if (request->deferred) {
+        deferred_result_return(request->deferred, output);
+    } else {
+        if (! gtk_widget_in_destruction(GTK_WIDGET(request->terminal))) {
+            char message[64];
+            snprintf(message, sizeof(message), "%i matches", count);
+            term_show_message_bar(request->terminal, message, 2000);
+        }
+        free(output);
+        g_object_unref(request->terminal);
+    }
+    free(request);
+}
+
+void do_search_all(VteTerminal* terminal, char* data, char** result, gboolean focus) {
+    SearchAllRequest* request = calloc(1, sizeof(SearchAllRequest));
+
+    if (! result) {
+        request->terminal = g_object_ref(terminal);
+    } else if (! (request->deferred = defer_action_result())) {
+        // the result only comes later, the caller has to be able to take it then
+        g_warning("search_all can only reply over the socket or through execute_line_async");
+        free(request);
+        return;
+    }
+
+    search_all_terminals(data, focus, (SearchAllCallback)search_all_done, request);
+}
+
+void search_all(VteTerminal* terminal, char* data, char** result) {
+    do_search_all(terminal, data, result, FALSE);
+}
+
+void search_all_focus(VteTerminal* terminal, char* data, char** result) {
+    do_search_all(terminal, data, result, TRUE);
+}
+
 void focus_searchbar(VteTerminal* terminal) {
     GtkWidget* grid = term_get_grid(terminal);
     GtkWidget* bar = g_object_get_data(G_OBJECT(grid), "searchbar");
@@ -732,6 +1195,30 @@ void hide_searchbar(VteTerminal* terminal) {
     search_bar_hide(bar);
 }
 
+void stats(VteTerminal* terminal, char* data, char** result) {
+    // key=value lines, optionally only a single section
+    if (! result) return;
+
+    GString* output = g_string_new(NULL);
+    if (! data || STR_EQUAL(data, "regex-cache")) {
+        regex_cache_stats(output);
+    }
+    if (! data || STR_EQUAL(data, "scheduler")) {
+        scheduler_stats(output);
+    }
+    if (! data || STR_EQUAL(data, "scrollback")) {
+        memory_scrollback_stats(output);
+    }
+    if (! data || STR_EQUAL(data, "reclaim")) {
+        memory_reclaim_stats(output);
+    }
+    *result = g_string_free(output, FALSE);
+}
+
+void memory_stats(VteTerminal* terminal, char* data, char** result) {
+    if (result) *result = memory_stats_json();
+}
+
 char* str_unescape(char* string) {
     // modifies in place
     char* p = string;
@@ -815,6 +1302,7 @@ Action make_action(char* name, char* arg) {
         MATCH_ACTION_WITH_DATA(feed_term, strdup(arg), free);
         MATCH_ACTION_WITH_DATA(new_tab, strdup(arg), free);
         MATCH_ACTION_WITH_DATA(new_window, strdup(arg), free);
+        MATCH_ACTION_WITH_DATA(layout, strdup(arg), free);
         MATCH_ACTION(prev_tab);
         MATCH_ACTION(next_tab);
         MATCH_ACTION(move_tab_prev);
@@ -836,6 +1324,19 @@ Action make_action(char* name, char* arg) {
         MATCH_ACTION_WITH_DATA(pipe_screen_ansi, strdup(arg), free);
         MATCH_ACTION_WITH_DATA(pipe_all, strdup(arg), free);
         MATCH_ACTION_WITH_DATA(pipe_all_ansi, strdup(arg), free);
+        MATCH_ACTION_WITH_DATA(pipe_rows, strdup(arg), free);
+        MATCH_ACTION_WITH_DATA(pipe_rows_ansi, strdup(arg), free);
+        MATCH_ACTION_WITH_DATA(pipe_since, strdup(arg), free);
+        MATCH_ACTION_WITH_DATA(pipe_all_snapshot, strdup(arg), free);
+        MATCH_ACTION_WITH_DATA(pipe_all_snapshot_ansi, strdup(arg), free);
+        MATCH_ACTION_WITH_DATA(log_search, strdup(arg), free);
+        MATCH_ACTION_WITH_DATA(record_rows, strdup(arg), free);
+        MATCH_ACTION(jump_prev_prompt);
+        MATCH_ACTION(jump_next_prompt);
+        MATCH_ACTION_WITH_DATA(pipe_last_output, strdup(arg), free);
+        MATCH_ACTION(select_last_output);
+        MATCH_ACTION_WITH_DATA(replay, strdup(arg), free);
+        MATCH_ACTION_WITH_DATA(log_export, strdup(arg), free);
         MATCH_ACTION_WITH_DATA(split_right, strdup(arg), free);
         MATCH_ACTION_WITH_DATA(split_left, strdup(arg), free);
         MATCH_ACTION_WITH_DATA(split_above, strdup(arg), free);
@@ -859,8 +1360,15 @@ Action make_action(char* name, char* arg) {
         MATCH_ACTION_WITH_DATA(search_down, strdup(arg), free);
         MATCH_ACTION_WITH_DATA(search_up, strdup(arg), free);
         MATCH_ACTION_WITH_DATA(search, strdup(arg), free);
+        MATCH_ACTION_WITH_DATA(search_all, strdup(arg), free);
+        MATCH_ACTION_WITH_DATA(search_all_focus, strdup(arg), free);
         MATCH_ACTION(focus_searchbar);
         MATCH_ACTION(hide_searchbar);
+        MATCH_ACTION_WITH_DATA(stats, strdup(arg), free);
+        MATCH_ACTION(memory_stats);
+
+        // actions registered by plugins
+        plugin_make_action(&action, name, arg);
         break;
     }
     return action;
@@ -926,5 +1434,8 @@ int trigger_action(VteTerminal* terminal, ActionKey key, ActionMetadata metadata
         }
         g_array_unref(list);
     }
+    if (key == EVENT_KEY && plugin_trigger_event(terminal, metadata)) {
+        handled = 1;
+    }
     return handled;
 }
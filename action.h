@@ -16,6 +16,13 @@ typedef struct {
     Action action;
 } ActionData;
 
+typedef void(*DeferredResultFunc)(char* result, gpointer data);
+
+typedef struct {
+    DeferredResultFunc func;
+    gpointer data;
+} DeferredResult;
+
 typedef guint32 ActionKey;
 typedef guint32 ActionMetadata;
 
@@ -26,7 +33,12 @@ void remove_all_action_bindings();
 
 Action make_action(char*, char*);
 void free_action(Action* action);
+int take_pending_snapshot_fd();
+char* execute_line_deferred(char* line, int size, DeferredResultFunc func, gpointer data, gboolean* deferred);
+DeferredResult* defer_action_result();
+void deferred_result_return(DeferredResult* deferred, char* result);
 
+GtkWidget* new_term(gchar* data, char** size, int** pipes);
 GtkWidget* new_tab(VteTerminal* terminal, char* data, int** pipes);
 GtkWidget* new_window(VteTerminal* terminal, char* data, int** pipes);
 GtkWidget* split_left(VteTerminal* terminal, char* data, int** pipes);
@@ -0,0 +1,94 @@
+#include <string.h>
+#include "ansi.h"
+
+/*
+ * serialize terminal text + attributes back into ansi escape sequences
+ * kept apart from terminal.c so bench/ansi_serialize.c can use it without a terminal
+ */
+
+#define COLOUR_EQUAL(x, y) ((x).red == (y).red && (x).green == (y).green && (x).blue == (y).blue)
+
+char* sgr_append_uint8(char* p, guint value) {
+    if (value >= 100) *p++ = '0' + value / 100;
+    if (value >= 10) *p++ = '0' + value / 10 % 10;
+    *p++ = '0' + value % 10;
+    return p;
+}
+
+char* sgr_append_colour(char* p, char type, const PangoColor* colour) {
+    *p++ = type;
+    memcpy(p, "8;2;", 4);
+    p += 4;
+    p = sgr_append_uint8(p, colour->red >> 8);
+    *p++ = ';';
+    p = sgr_append_uint8(p, colour->green >> 8);
+    *p++ = ';';
+    p = sgr_append_uint8(p, colour->blue >> 8);
+    *p++ = ';';
+    return p;
+}
+
+char* ansi_serialize(const char* text, GArray* attrs) {
+    /*
+     * vte gives one attribute per byte of text
+     * so walk whole utf8 characters, group them into runs of identical attributes
+     * and only emit a (single) sgr sequence at the start of each run
+     */
+
+    size_t length = strlen(text);
+    const char* end = text + length;
+    // most runs are long, so this is usually enough to avoid reallocating
+    GString* output = g_string_sized_new(length + length / 8 + SGR_MAX_LENGTH);
+
+    const VteCharAttributes* prev = NULL;
+    const char* run = text;
+    char sgr[SGR_MAX_LENGTH];
+
+    for (const char* c = text; c < end; c = g_utf8_next_char(c)) {
+        guint index = c - text;
+        if (index >= attrs->len) break;
+
+        const VteCharAttributes* a = &g_array_index(attrs, VteCharAttributes, index);
+        if (prev
+                && COLOUR_EQUAL(a->fore, prev->fore)
+                && COLOUR_EQUAL(a->back, prev->back)
+                && a->underline == prev->underline
+                && a->strikethrough == prev->strikethrough) {
+            continue;
+        }
+
+        // flush the previous run
+        g_string_append_len(output, run, c - run);
+        run = c;
+
+        char* p = sgr;
+        *p++ = '\x1b';
+        *p++ = '[';
+        if (! prev || ! COLOUR_EQUAL(a->fore, prev->fore)) {
+            p = sgr_append_colour(p, '3', &a->fore);
+        }
+        if (! prev || ! COLOUR_EQUAL(a->back, prev->back)) {
+            p = sgr_append_colour(p, '4', &a->back);
+        }
+        if (! prev || a->underline != prev->underline) {
+            if (! a->underline) *p++ = '2';
+            *p++ = '4';
+            *p++ = ';';
+        }
+        if (! prev || a->strikethrough != prev->strikethrough) {
+            if (! a->strikethrough) *p++ = '2';
+            *p++ = '9';
+            *p++ = ';';
+        }
+        // replace trailing ;
+        p[-1] = 'm';
+        g_string_append_len(output, sgr, p - sgr);
+        prev = a;
+    }
+
+    g_string_append_len(output, run, end - run);
+    if (prev) {
+        g_string_append_len(output, "\x1b[0m", 4);
+    }
+    return g_string_free(output, FALSE);
+}
@@ -0,0 +1,11 @@
+#ifndef ANSI_H
+#define ANSI_H
+
+#include <vte/vte.h>
+
+// longest possible sgr: \x1b[38;2;255;255;255;48;2;255;255;255;24;29m
+#define SGR_MAX_LENGTH 64
+
+char* ansi_serialize(const char* text, GArray* attrs);
+
+#endif
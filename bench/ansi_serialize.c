@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "../ansi.h"
+
+/*
+ * throughput of ansi_serialize on a coloured scrollback, as used by pipe_*_ansi, snapshots and recording
+ * 100k lines of mixed ascii + utf8, with the colour changing every 8 bytes
+ *
+ *      make bench
+ */
+
+#define BENCH_LINES 100000
+#define BENCH_RUNS 10
+
+int main() {
+    const char* words[] = {"hello ", "wörld ", "ERROR ", "→arrow ", "plain "};
+    GString* text = g_string_new(NULL);
+    for (int line = 0; line < BENCH_LINES; line ++) {
+        for (int word = 0; word < 12; word ++) {
+            g_string_append(text, words[(line + word) % G_N_ELEMENTS(words)]);
+        }
+        g_string_append_c(text, '\n');
+    }
+
+    // vte gives one attribute per byte
+    GArray* attrs = g_array_sized_new(FALSE, TRUE, sizeof(VteCharAttributes), text->len);
+    g_array_set_size(attrs, text->len);
+    for (gsize i = 0; i < text->len; i ++) {
+        VteCharAttributes* attr = &g_array_index(attrs, VteCharAttributes, i);
+        int colour = (i / 8) % 4;
+        attr->fore.red = colour * 0x4000;
+        attr->back.blue = (i / 64) % 2 ? 0xffff : 0;
+        attr->underline = colour == 3;
+    }
+
+    gsize output_length = 0;
+    gint64 start = g_get_monotonic_time();
+    for (int i = 0; i < BENCH_RUNS; i ++) {
+        char* output = ansi_serialize(text->str, attrs);
+        output_length = strlen(output);
+        free(output);
+    }
+    double elapsed = (g_get_monotonic_time() - start) / (double)G_USEC_PER_SEC;
+
+    printf(
+        "ansi_serialize: %i lines, %.1f MB in, %.1f MB out, %.1f ms per run, %.0f MB/s\n",
+        BENCH_LINES, text->len / 1e6, output_length / 1e6,
+        elapsed * 1000 / BENCH_RUNS, text->len * BENCH_RUNS / elapsed / 1e6
+    );
+
+    g_array_free(attrs, TRUE);
+    g_string_free(text, TRUE);
+    return 0;
+}
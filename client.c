@@ -1,4 +1,6 @@
 #include <glib-unix.h>
+#include <gio/gunixfdmessage.h>
+#include <unistd.h>
 #include "client.h"
 #include "socket.h"
 #include "config.h"
@@ -53,6 +55,19 @@ int client_pipe_over_sock(GSocket* sock, char* value, gboolean connect_stdin, gb
     return 0;
 }
 
+int client_dump_fd(int fd) {
+    // copy a file passed over the socket to stdout
+    char buffer[BUFFER_DEFAULT_SIZE*16];
+    ssize_t len;
+    lseek(fd, 0, SEEK_SET);
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+        if (write_to_fd(STDOUT_FILENO, buffer, len) < 0) {
+            return 1;
+        }
+    }
+    return len < 0;
+}
+
 int client_send_line(GSocket* sock, char* line, Buffer* buffer) {
     GError* error = NULL;
     int len = strlen(line) + 1;
@@ -61,26 +76,34 @@ int client_send_line(GSocket* sock, char* line, Buffer* buffer) {
         return 1;
     }
 
-    /* get the response */
+    /* get the response, and any fd attached to it e.g. from pipe_all_snapshot */
+    int fd = -1;
     while (1) {
-        len = g_socket_receive(sock, buffer->data + buffer->used, buffer->reserved - buffer->used, NULL, &error);
+        GInputVector vector = {buffer->data + buffer->used, buffer->reserved - buffer->used};
+        GSocketControlMessage** messages = NULL;
+        int nmessages = 0;
+        len = g_socket_receive_message(sock, NULL, &vector, 1, &messages, &nmessages, NULL, NULL, &error);
+        sock_take_fds(messages, nmessages, &fd);
+
         if (len < 0) {
             g_warning("Failed to recv(): %s", error->message);
             g_error_free(error);
+            if (fd >= 0) close(fd);
             return 1;
         }
 
         if (len == 0) {
             // unexpected eof
             g_warning("Unexpected EOF");
+            if (fd >= 0) close(fd);
             return 1;
         }
 
         char* end = memchr(buffer->data + buffer->used, 0, len);
 
-        /* dump existing buffer */
+        /* dump existing buffer, unless an fd came with it, then the reply is just its size */
         int size = end ? (end - buffer->data) : (buffer->used + len);
-        if (write_to_fd(STDOUT_FILENO, buffer->data, size) < 0) {
+        if (fd < 0 && write_to_fd(STDOUT_FILENO, buffer->data, size) < 0) {
             return 1;
         }
 
@@ -93,6 +116,13 @@ int client_send_line(GSocket* sock, char* line, Buffer* buffer) {
 
         buffer->used = 0;
     }
+
+    if (fd >= 0) {
+        // print the contents instead
+        result = client_dump_fd(fd);
+        close(fd);
+        return result;
+    }
     return 0;
 }
 
@@ -9,6 +9,9 @@
 #include "split.h"
 #include "utils.h"
 #include "tab_title_ui.h"
+#include "output_match.h"
+#include "plugin.h"
+#include "memory.h"
 
 guint timer_id = 0;
 char* config_filename = NULL;
@@ -32,13 +35,17 @@ gboolean terminal_audible_bell = FALSE;
 gboolean terminal_allow_hyperlink = FALSE;
 gboolean terminal_pointer_autohide = FALSE;
 gboolean terminal_rewrap_on_resize = TRUE;
+int rewrap_resize_delay = 250;
 gboolean terminal_scroll_on_keystroke = TRUE;
 gboolean terminal_scroll_on_output = TRUE;
 guint terminal_default_scrollback_lines = 0;
+char* scrollback_log_dir = NULL;
+int worker_processes = 0;
 char* terminal_word_char_exceptions = NULL;
 
 gboolean tab_expand = TRUE;
 gboolean tab_fill = TRUE;
+gboolean tab_virtualise = FALSE;
 gboolean notebook_enable_popup = FALSE;
 gboolean notebook_scrollable = FALSE;
 int notebook_show_tabs = OPTION_SMART;
@@ -48,6 +55,9 @@ int ui_refresh_interval = 5000;
 PangoEllipsizeMode tab_label_ellipsize_mode = PANGO_ELLIPSIZE_END;
 gfloat tab_label_alignment = 0.5;
 int inactivity_duration = 10000;
+int background_output_budget = 2;
+int scrollback_memory_budget = 0;
+int memory_reclaim = MEMORY_RECLAIM_NORMAL;
 gboolean window_close_confirm = TRUE;
 gint tab_close_confirm = OPTION_SMART;
 guint message_bar_animation_duration = 250;
@@ -57,6 +67,9 @@ int search_case_sensitive = REGEX_CASE_SMART;
 gboolean search_use_regex = FALSE;
 gboolean search_wrap_around = TRUE;
 guint search_bar_animation_duration = 250;
+guint search_debounce_interval = 100;
+gboolean search_highlight_all = FALSE;
+GdkRGBA search_highlight_colour = {1, 1, 0, 0.3};
 
 char** shell_split(char* string, gint* argc) {
     if (! string || *string == '\0') {
@@ -280,16 +293,20 @@ int handle_config(char* line, size_t len, char** result) {
         return 1;
     }
 
+    MAP_LINE("worker-processes",        MAP_INT(worker_processes));
+    MAP_LINE("load-plugin",             if (value) plugin_load(value));
     MAP_LINE("background",              MAP_COLOUR(&BACKGROUND));
     MAP_LINE("foreground",              MAP_COLOUR(&FOREGROUND));
     MAP_LINE("window-title-format",     if (value) set_window_title_format(value)); // TODO
     MAP_LINE("tab-label-format",        MAP_STR(tab_label_format); if (value) { free(tab_title_ui_format); tab_title_ui_format = NULL; } );
     MAP_LINE("tab-title-ui",            MAP_STR(tab_title_ui_format); if (value) { free(tab_label_format); tab_label_format= NULL; } );
     MAP_LINE("tab-fill",                MAP_BOOL(tab_fill));
+    MAP_LINE("tab-virtualise",          MAP_BOOL(tab_virtualise));
     MAP_LINE("tab-expand",              MAP_BOOL(tab_expand));
     MAP_LINE("tab-enable-popup",        MAP_BOOL(notebook_enable_popup));
     MAP_LINE("tab-scrollable",          MAP_BOOL(notebook_scrollable));
     MAP_LINE("show-new-tab-button",     MAP_BOOL(notebook_show_new_tab_button));
+    MAP_LINE("background-output-budget", MAP_INT(background_output_budget));
     MAP_LINE("ui-refresh-interval",     MAP_INT(ui_refresh_interval));
     MAP_LINE("inactivity-duration",     MAP_INT(inactivity_duration));
     MAP_LINE("encoding",                MAP_STR(terminal_encoding));
@@ -298,15 +315,21 @@ int handle_config(char* line, size_t len, char** result) {
     MAP_LINE("allow-hyperlink",         MAP_BOOL(terminal_allow_hyperlink));
     MAP_LINE("pointer-autohide",        MAP_BOOL(terminal_pointer_autohide));
     MAP_LINE("rewrap-on-resize",        MAP_BOOL(terminal_rewrap_on_resize));
+    MAP_LINE("rewrap-resize-delay",     MAP_INT(rewrap_resize_delay));
     MAP_LINE("scroll-on-keystroke",     MAP_BOOL(terminal_scroll_on_keystroke));
     MAP_LINE("scroll-on-output",        MAP_BOOL(terminal_scroll_on_output));
     MAP_LINE("default-scrollback-lines",MAP_INT(terminal_default_scrollback_lines));
+    MAP_LINE("scrollback-log-dir",      MAP_STR(scrollback_log_dir));
+    MAP_LINE("scrollback-memory-budget", MAP_INT(scrollback_memory_budget));
     MAP_LINE("word-char-exceptions",    MAP_STR(terminal_word_char_exceptions));
     MAP_LINE("window-icon",             MAP_STR(window_icon));
     MAP_LINE("window-close-confirm",    MAP_BOOL(window_close_confirm));
     MAP_LINE("search-use-regex",        MAP_BOOL(search_use_regex));
     MAP_LINE("search-wrap-around",      MAP_BOOL(search_wrap_around));
     MAP_LINE("search-bar-animation-duration", MAP_INT(search_bar_animation_duration));
+    MAP_LINE("search-debounce-interval", MAP_INT(search_debounce_interval));
+    MAP_LINE("search-highlight-all",    MAP_BOOL(search_highlight_all));
+    MAP_LINE("search-highlight-colour", MAP_COLOUR(&search_highlight_colour));
     MAP_LINE("message-bar-animation-duration", MAP_INT(message_bar_animation_duration));
 
     if (LINE_EQUALS("font")) {
@@ -404,6 +427,12 @@ int handle_config(char* line, size_t len, char** result) {
         return 1;
     }
 
+    MAP_LINE_VALUE("memory-reclaim", int, memory_reclaim,
+            {"off",        MEMORY_RECLAIM_OFF},
+            {"normal",     MEMORY_RECLAIM_NORMAL},
+            {"aggressive", MEMORY_RECLAIM_AGGRESSIVE},
+    );
+
     MAP_LINE_VALUE("tab-pos", int, notebook_tab_pos,
             {"top",    GTK_POS_TOP},
             {"bottom", GTK_POS_BOTTOM},
@@ -434,6 +463,11 @@ int handle_config(char* line, size_t len, char** result) {
             {"window",    "new_window"},
     );
 
+    if (value && (tmp = STR_STRIP_PREFIX(line, "on-output-match-"))) {
+        output_match_set(tmp, value);
+        return 1;
+    }
+
     // ONLY events from here on
     // events must take a value
     char* event;
@@ -500,12 +534,17 @@ gboolean refresh_ui() {
 }
 
 void reconfigure_all() {
+    static gboolean tab_titles_virtualised = FALSE;
     gboolean tab_titles_changed = FALSE;
     if (tab_title_ui_format) {
         tab_titles_changed = set_tab_title_ui(tab_title_ui_format);
     } else {
         tab_titles_changed = set_tab_label_format(tab_label_format ? tab_label_format : "%t", tab_label_ellipsize_mode, tab_label_alignment);
     }
+    if (tab_titles_virtualised != tab_virtualise) {
+        tab_titles_virtualised = tab_virtualise;
+        tab_titles_changed = TRUE;
+    }
 
     if (tab_titles_changed) {
         destroy_all_tab_title_uis();
@@ -518,6 +557,9 @@ void reconfigure_all() {
 
     if (timer_id) g_source_remove(timer_id);
     timer_id = g_timeout_add(ui_refresh_interval, refresh_ui, NULL);
+
+    // the budget may have shrunk
+    memory_check_budget();
 }
 
 void* execute_line(char* line, int size, gboolean reconfigure, gboolean do_actions) {
@@ -556,6 +598,7 @@ void* execute_line(char* line, int size, gboolean reconfigure, gboolean do_actio
 
 void reset_config() {
     remove_all_action_bindings();
+    output_match_reset();
     reset_palette();
 }
 
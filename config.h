@@ -28,10 +28,18 @@ char* app_id;
 char* config_filename;
 char** default_args;
 int inactivity_duration;
+int background_output_budget;
 char* default_open_action;
 gboolean tab_expand;
+gboolean tab_virtualise;
 guint terminal_default_scrollback_lines;
+char* scrollback_log_dir;
+int scrollback_memory_budget;
+int memory_reclaim;
+int worker_processes;
 gboolean show_scrollbar;
+gboolean terminal_rewrap_on_resize;
+int rewrap_resize_delay;
 
 #define OPTION_NO 0
 #define OPTION_YES 1
@@ -46,6 +54,9 @@ int notebook_show_tabs;
 #define REGEX_CASE_SMART 2
 int search_case_sensitive;
 gboolean search_use_regex;
+guint search_debounce_interval;
+gboolean search_highlight_all;
+GdkRGBA search_highlight_colour;
 char* search_pattern;
 
 #define EVENT_KEY 0
@@ -0,0 +1,494 @@
+#include <gtk/gtk.h>
+#include <string.h>
+#include "layout.h"
+#include "action.h"
+#include "split.h"
+#include "window.h"
+#include "terminal.h"
+#include "utils.h"
+
+/*
+ * build whole tabs of splits in one go, e.g.
+ *      layout: h(30%:{htop}, v({cwd=/tmp}, {vim}))
+ *
+ * node  := split | term
+ * split := ('h' | 'v') '(' child (',' child)* ')'      h is side by side, v is stacked
+ * child := [size ':'] node                             size like split_*, 30% 80 (cells) 200px
+ * term  := '{' arguments '}'                           same as new_tab, {} for the default
+ *
+ * each top level node is a new tab, prefix with `window` to put them in a new window
+ *
+ * the paned tree is built off screen and only then added to the notebook
+ * so there is a single allocation for the whole tab rather than one per split
+ *
+ * prefix with `sequential` to instead build it the way separate new_tab/split_* commands would
+ * (one terminal at a time from the main loop, allocating and drawing in between) to compare the timings
+ * either way the time is measured up to the window painting the result
+ */
+
+typedef struct {
+    char orientation; // 0 for terminals
+    char* size;
+    char* args;
+    GPtrArray* children;
+} LayoutNode;
+
+typedef struct {
+    GtkOrientation orientation;
+    int n;
+    char** sizes;
+    GtkWidget** children;
+    GtkWidget** panes;
+} LayoutSizes;
+
+typedef struct {
+    // index into the job terminals of the one to split, -1 for a new tab
+    int from;
+    char orientation;
+    char* args;
+} LayoutStep;
+
+typedef struct {
+    gint64 start;
+    gint64 painted;
+    gboolean new_window;
+    GPtrArray* nodes;
+    // refs, NULL where nothing could be made
+    GPtrArray* terminals;
+    GtkWidget* window;
+    VteTerminal* focus;
+    guint tabs;
+    DeferredResult* deferred;
+
+    // sequential builds, one terminal per step
+    GArray* steps;
+    guint step;
+
+    GdkFrameClock* clock;
+    gulong paint_handler;
+    guint paint_timeout;
+    GSourceFunc next;
+} LayoutJob;
+
+void layout_node_free(LayoutNode* node) {
+    if (! node) return;
+    free(node->size);
+    free(node->args);
+    if (node->children) g_ptr_array_free(node->children, TRUE);
+    free(node);
+}
+
+char* layout_skip_space(char* p) {
+    while (g_ascii_isspace(*p)) p ++;
+    return p;
+}
+
+char* layout_find_close_brace(char* p) {
+    // respect quotes, as the contents get shell split
+    char quote = 0;
+    for ( ; *p; p ++) {
+        if (*p == '\\' && quote != '\'' && p[1]) {
+            p ++;
+        } else if (quote) {
+            if (*p == quote) quote = 0;
+        } else if (*p == '\'' || *p == '"') {
+            quote = *p;
+        } else if (*p == '}') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+LayoutNode* layout_parse_node(char** string) {
+    char* p = layout_skip_space(*string);
+    LayoutNode* node = calloc(1, sizeof(LayoutNode));
+
+    if (*p == '{') {
+        char* end = layout_find_close_brace(p+1);
+        if (! end) {
+            g_warning("Missing } in layout: %s", p);
+            free(node);
+            return NULL;
+        }
+        node->args = g_strstrip(strndup(p+1, end-p-1));
+        *string = end+1;
+        return node;
+    }
+
+    char orientation = *p;
+    if ((orientation == 'h' || orientation == 'v') && *(p = layout_skip_space(p+1)) == '(') {
+        node->orientation = orientation;
+        node->children = g_ptr_array_new_with_free_func((GDestroyNotify)layout_node_free);
+        p ++;
+
+        while (1) {
+            p = layout_skip_space(p);
+
+            // optional size
+            char* size = NULL;
+            char* colon = strchr(p, ':');
+            if (g_ascii_isdigit(*p) && colon) {
+                size = g_strstrip(strndup(p, colon-p));
+                p = colon+1;
+            }
+
+            LayoutNode* child = layout_parse_node(&p);
+            if (! child) {
+                free(size);
+                layout_node_free(node);
+                return NULL;
+            }
+            child->size = size;
+            g_ptr_array_add(node->children, child);
+
+            p = layout_skip_space(p);
+            if (*p == ',') {
+                p ++;
+            } else if (*p == ')') {
+                *string = p+1;
+                return node;
+            } else {
+                g_warning("Expected , or ) in layout: %s", p);
+                layout_node_free(node);
+                return NULL;
+            }
+        }
+    }
+
+    g_warning("Invalid layout: %s", *string);
+    free(node);
+    return NULL;
+}
+
+VteTerminal* layout_first_terminal(GtkWidget* widget) {
+    while (GTK_IS_PANED(widget)) {
+        widget = gtk_paned_get_child1(GTK_PANED(widget));
+    }
+    return widget ? g_object_get_data(G_OBJECT(widget), "terminal") : NULL;
+}
+
+int layout_size_to_pixels(const char* size, int total, GtkOrientation orientation, GtkWidget* child) {
+    // -1 for no size
+    if (! size) return -1;
+
+    char* units;
+    int value = strto10l((char*)size, &units);
+    if (value <= 0) return -1;
+
+    if (STR_EQUAL(units, "%")) {
+        return total*value/100;
+    } else if (STR_EQUAL(units, "px")) {
+        return value;
+    }
+
+    VteTerminal* terminal = layout_first_terminal(child);
+    if (! terminal) return -1;
+    return value * (orientation == GTK_ORIENTATION_HORIZONTAL ? vte_terminal_get_char_width(terminal) : vte_terminal_get_char_height(terminal));
+}
+
+void layout_sizes_free(LayoutSizes* sizes) {
+    for (int i = 0; i < sizes->n; i ++) {
+        free(sizes->sizes[i]);
+    }
+    free(sizes->sizes);
+    free(sizes->children);
+    free(sizes->panes);
+    free(sizes);
+}
+
+void layout_apply_sizes(GtkWidget* paned, GdkRectangle* rect, LayoutSizes* sizes) {
+    /*
+     * on the first allocation, position every separator of the chain at once
+     * children without a size share what is left equally
+     */
+    int total = sizes->orientation == GTK_ORIENTATION_HORIZONTAL ? rect->width : rect->height;
+    total -= (sizes->n - 1) * split_get_separator_size(paned);
+
+    int pixels[sizes->n];
+    int used = 0, unsized = 0;
+    for (int i = 0; i < sizes->n; i ++) {
+        pixels[i] = layout_size_to_pixels(sizes->sizes[i], total, sizes->orientation, sizes->children[i]);
+        if (pixels[i] < 0) {
+            unsized ++;
+        } else {
+            used += pixels[i];
+        }
+    }
+
+    int share = unsized ? MAX(0, total - used) / unsized : 0;
+    for (int i = 0; i < sizes->n - 1; i ++) {
+        gtk_paned_set_position(GTK_PANED(sizes->panes[i]), pixels[i] < 0 ? share : pixels[i]);
+    }
+
+    // frees sizes
+    g_signal_handlers_disconnect_by_func(paned, layout_apply_sizes, sizes);
+}
+
+GtkWidget* layout_build_node(LayoutNode* node, GPtrArray* terminals) {
+    if (! node->orientation) {
+        GtkWidget* grid = new_term(node->args[0] ? node->args : NULL, NULL, NULL);
+        if (grid) g_ptr_array_add(terminals, g_object_ref(g_object_get_data(G_OBJECT(grid), "terminal")));
+        return grid;
+    }
+
+    int n = node->children->len;
+    GtkWidget* widgets[n];
+    for (int i = 0; i < n; i ++) {
+        widgets[i] = layout_build_node(node->children->pdata[i], terminals);
+        if (! widgets[i]) {
+            for (int j = 0; j < i; j ++) {
+                gtk_widget_destroy(widgets[j]);
+            }
+            return NULL;
+        }
+    }
+    if (n == 1) return widgets[0];
+
+    GtkOrientation orientation = node->orientation == 'h' ? GTK_ORIENTATION_HORIZONTAL : GTK_ORIENTATION_VERTICAL;
+    LayoutSizes* sizes = malloc(sizeof(LayoutSizes));
+    sizes->orientation = orientation;
+    sizes->n = n;
+    sizes->sizes = malloc(sizeof(char*) * n);
+    sizes->children = malloc(sizeof(GtkWidget*) * n);
+    sizes->panes = malloc(sizeof(GtkWidget*) * (n-1));
+
+    // a chain of panes, each with the next child on the left and the rest on the right
+    GtkWidget* result = widgets[n-1];
+    for (int i = n-2; i >= 0; i --) {
+        GtkWidget* paned = gtk_paned_new(orientation);
+        gtk_paned_set_wide_handle(GTK_PANED(paned), TRUE);
+        gtk_paned_pack1(GTK_PANED(paned), widgets[i], TRUE, FALSE);
+        gtk_paned_pack2(GTK_PANED(paned), result, TRUE, FALSE);
+        sizes->panes[i] = result = paned;
+    }
+    for (int i = 0; i < n; i ++) {
+        // the nodes are gone by the first allocation
+        char* size = ((LayoutNode*)node->children->pdata[i])->size;
+        sizes->sizes[i] = size ? strdup(size) : NULL;
+        sizes->children[i] = widgets[i];
+    }
+
+    g_signal_connect_data(result, "size-allocate", G_CALLBACK(layout_apply_sizes), sizes, (GClosureNotify)layout_sizes_free, 0);
+    return result;
+}
+
+char* layout_skip_keyword(char* p, const char* keyword) {
+    // returns the position after keyword, or NULL if it is not there
+    size_t length = strlen(keyword);
+    if (strncmp(p, keyword, length) == 0 && ! g_ascii_isalnum(p[length])) {
+        return layout_skip_space(p + length);
+    }
+    return NULL;
+}
+
+LayoutNode* layout_first_leaf(LayoutNode* node) {
+    while (node->orientation) {
+        node = node->children->pdata[0];
+    }
+    return node;
+}
+
+void layout_unref(gpointer object) {
+    if (object) g_object_unref(object);
+}
+
+gboolean layout_painted(LayoutJob* job) {
+    job->painted = g_get_monotonic_time();
+    g_signal_handler_disconnect(job->clock, job->paint_handler);
+    g_object_unref(job->clock);
+    job->clock = NULL;
+    g_source_remove(job->paint_timeout);
+
+    // carry on outside of the paint
+    g_idle_add(job->next, job);
+    return G_SOURCE_REMOVE;
+}
+
+void layout_wait_paint(LayoutJob* job, GSourceFunc next) {
+    // call next once the window has allocated and drawn what has been added so far
+    job->painted = 0;
+    job->next = next;
+    GdkFrameClock* clock = job->window && ! gtk_widget_in_destruction(job->window) ? gtk_widget_get_frame_clock(job->window) : NULL;
+    if (! clock) {
+        g_idle_add(next, job);
+        return;
+    }
+
+    job->clock = g_object_ref(clock);
+    job->paint_handler = g_signal_connect_swapped(clock, "after-paint", G_CALLBACK(layout_painted), job);
+    gdk_frame_clock_request_phase(clock, GDK_FRAME_CLOCK_PHASE_AFTER_PAINT);
+    // e.g. minimised windows may not paint at all
+    job->paint_timeout = g_timeout_add(LAYOUT_PAINT_TIMEOUT, (GSourceFunc)layout_painted, job);
+}
+
+gboolean layout_finish(LayoutJob* job) {
+    if (job->deferred) {
+        guint count = 0;
+        for (guint i = 0; i < job->terminals->len; i ++) {
+            if (job->terminals->pdata[i]) count ++;
+        }
+        gint64 end = job->painted ? job->painted : g_get_monotonic_time();
+        deferred_result_return(job->deferred, g_strdup_printf("terminals=%u tabs=%u time-ms=%.3f\n", count, job->tabs, (end - job->start) / 1000.0));
+    }
+
+    g_ptr_array_free(job->terminals, TRUE);
+    g_ptr_array_free(job->nodes, TRUE);
+    if (job->steps) g_array_free(job->steps, TRUE);
+    if (job->window) g_object_unref(job->window);
+    free(job);
+    return G_SOURCE_REMOVE;
+}
+
+void layout_focus(LayoutJob* job) {
+    if (job->focus && ! gtk_widget_in_destruction(GTK_WIDGET(job->focus))) {
+        term_set_focus(job->focus, TRUE);
+    }
+}
+
+void layout_add_tab(LayoutJob* job, GtkWidget* widget, guint first) {
+    // widget holds the terminals from first onwards
+    GtkWidget* tab = split_new_root();
+    gtk_paned_pack1(GTK_PANED(tab), widget, TRUE, TRUE);
+    // focus chain, first terminal of the tab is active
+    for (guint j = job->terminals->len; j > first; j --) {
+        split_set_active_term(job->terminals->pdata[j-1]);
+    }
+
+    // only make the window once there is something to put in it
+    if (job->window && gtk_widget_in_destruction(job->window)) {
+        g_clear_object(&job->window);
+    }
+    if (! job->window) {
+        GtkWidget* window = job->new_window || job->tabs ? NULL : get_active_window();
+        job->window = g_object_ref(window ? window : make_window());
+    }
+    add_tab_to_window(job->window, tab, -1);
+    job->tabs ++;
+
+    if (! job->focus) {
+        job->focus = job->terminals->pdata[first];
+        gtk_window_present(GTK_WINDOW(job->window));
+        layout_focus(job);
+    }
+}
+
+void layout_plan_sequential(LayoutJob* job, LayoutNode* node, int first) {
+    /*
+     * first is the step making the terminal in place of node
+     * split off the first terminal of each of the other children, then fill in each child the same way
+     * sizes are left out, they do not mean the same thing for split_*
+     */
+    if (! node->orientation) return;
+
+    int n = node->children->len;
+    int firsts[n];
+    firsts[0] = first;
+    for (int i = 1; i < n; i ++) {
+        LayoutStep step = {firsts[i-1], node->orientation, layout_first_leaf(node->children->pdata[i])->args};
+        firsts[i] = job->steps->len;
+        g_array_append_val(job->steps, step);
+    }
+
+    for (int i = 0; i < n; i ++) {
+        layout_plan_sequential(job, node->children->pdata[i], firsts[i]);
+    }
+}
+
+gboolean layout_sequential_step(LayoutJob* job) {
+    // each step makes job->terminals[step]
+    if (job->step >= job->steps->len) {
+        layout_focus(job);
+        layout_wait_paint(job, (GSourceFunc)layout_finish);
+        return G_SOURCE_REMOVE;
+    }
+
+    LayoutStep* step = &g_array_index(job->steps, LayoutStep, job->step);
+    job->step ++;
+    char* args = step->args[0] ? strdup(step->args) : NULL;
+    GtkWidget* grid = NULL;
+
+    if (step->from < 0) {
+        grid = new_term(args, NULL, NULL);
+        if (grid) {
+            g_ptr_array_add(job->terminals, g_object_ref(g_object_get_data(G_OBJECT(grid), "terminal")));
+            layout_add_tab(job, grid, job->terminals->len-1);
+        }
+    } else {
+        // may have been closed in the meantime
+        VteTerminal* from = job->terminals->pdata[step->from];
+        if (from && ! gtk_widget_in_destruction(GTK_WIDGET(from))) {
+            grid = step->orientation == 'h' ? split_right(from, args, NULL) : split_below(from, args, NULL);
+        }
+        if (grid) g_ptr_array_add(job->terminals, g_object_ref(g_object_get_data(G_OBJECT(grid), "terminal")));
+    }
+    free(args);
+
+    if (grid) {
+        // what running each split as its own command costs: allocate and draw in between
+        layout_wait_paint(job, (GSourceFunc)layout_sequential_step);
+    } else {
+        g_ptr_array_add(job->terminals, NULL);
+        g_idle_add((GSourceFunc)layout_sequential_step, job);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void layout_build(char* string, gboolean reply) {
+    /*
+     * with reply, the result is passed on through defer_action_result
+     * once the window has painted, so it cannot be given from here
+     */
+    gint64 start = g_get_monotonic_time();
+
+    char* p = layout_skip_space(string);
+    char* after;
+    gboolean sequential = (after = layout_skip_keyword(p, "sequential")) != NULL;
+    if (sequential) p = after;
+    gboolean new_window = (after = layout_skip_keyword(p, "window")) != NULL;
+    if (new_window) p = after;
+
+    // parse everything first so nothing is built from an invalid layout
+    GPtrArray* nodes = g_ptr_array_new_with_free_func((GDestroyNotify)layout_node_free);
+    while (*(p = layout_skip_space(p))) {
+        LayoutNode* node = layout_parse_node(&p);
+        if (! node) {
+            g_ptr_array_free(nodes, TRUE);
+            return;
+        }
+        g_ptr_array_add(nodes, node);
+    }
+
+    LayoutJob* job = calloc(1, sizeof(LayoutJob));
+    job->start = start;
+    job->new_window = new_window;
+    job->nodes = nodes;
+    job->terminals = g_ptr_array_new_with_free_func(layout_unref);
+    job->deferred = reply ? defer_action_result() : NULL;
+
+    if (sequential) {
+        // new_tab then split_* for each tab in turn, from the main loop
+        job->steps = g_array_new(FALSE, FALSE, sizeof(LayoutStep));
+        for (guint i = 0; i < nodes->len; i ++) {
+            LayoutStep step = {-1, 0, layout_first_leaf(nodes->pdata[i])->args};
+            int first = job->steps->len;
+            g_array_append_val(job->steps, step);
+            layout_plan_sequential(job, nodes->pdata[i], first);
+        }
+        g_idle_add((GSourceFunc)layout_sequential_step, job);
+        return;
+    }
+
+    for (guint i = 0; i < nodes->len; i ++) {
+        guint first = job->terminals->len;
+        GtkWidget* widget = layout_build_node(nodes->pdata[i], job->terminals);
+        if (! widget) {
+            // anything built for this tab has been destroyed
+            g_ptr_array_set_size(job->terminals, first);
+            continue;
+        }
+        layout_add_tab(job, widget, first);
+    }
+    layout_focus(job);
+    layout_wait_paint(job, (GSourceFunc)layout_finish);
+}
@@ -0,0 +1,11 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <glib.h>
+
+// how long to wait for the window to paint before giving up on timing it
+#define LAYOUT_PAINT_TIMEOUT 1000
+
+void layout_build(char* string, gboolean reply);
+
+#endif
@@ -0,0 +1,358 @@
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <unistd.h>
+#include "memory.h"
+#include "terminal.h"
+#include "scheduler.h"
+#include "split.h"
+#include "window.h"
+#include "config.h"
+#include "socket.h"
+#include "tab_title_ui.h"
+#include "regex_cache.h"
+
+/*
+ * global scrollback-memory-budget across all terminals
+ *
+ * once over budget, the scrollback of the least recently focused terminals is
+ * trimmed first, visible terminals are never trimmed
+ * with scrollback-log-dir set, trimmed rows are still in the log (see log_search)
+ * and the scheduler only defers as much output as fits in the trimmed scrollback
+ * so the log keeps getting everything afterwards too
+ * a trimmed terminal gets its original scrollback-lines back when next focused
+ *
+ * sizes are estimates of the uncompressed rows, vte keeps scrollback compressed
+ * in unlinked files in $TMPDIR so this is really ram if that is a tmpfs
+ */
+
+guint memory_check_timer = 0;
+guint memory_focus_serial = 0;
+
+// counters
+guint64 memory_trims = 0;
+guint64 memory_trimmed_bytes = 0;
+// set while scrollback-lines is being changed from here
+gboolean memory_setting_scrollback = FALSE;
+
+gsize memory_row_bytes(VteTerminal* terminal) {
+    return vte_terminal_get_column_count(terminal) + MEMORY_ROW_OVERHEAD;
+}
+
+gsize memory_term_scrollback_bytes(VteTerminal* terminal, glong* rows) {
+    int lower, upper;
+    term_get_row_positions(terminal, NULL, NULL, &lower, &upper);
+    glong scrollback = MAX(0, upper - lower - vte_terminal_get_row_count(terminal));
+    if (rows) *rows = scrollback;
+    return scrollback * memory_row_bytes(terminal);
+}
+
+void memory_touch(VteTerminal* terminal) {
+    g_object_set_data(G_OBJECT(terminal), "focus-serial", GUINT_TO_POINTER(++memory_focus_serial));
+
+    int* untrimmed = g_object_get_data(G_OBJECT(terminal), "scrollback-untrimmed");
+    if (untrimmed) {
+        memory_setting_scrollback = TRUE;
+        g_object_set(G_OBJECT(terminal), "scrollback-lines", *untrimmed, NULL);
+        memory_setting_scrollback = FALSE;
+        g_object_set_data(G_OBJECT(terminal), "scrollback-untrimmed", NULL);
+    }
+}
+
+void memory_scrollback_lines_changed(VteTerminal* terminal, GParamSpec* pspec) {
+    // set from elsewhere (e.g. config), that is what to go back to now rather than the value before trimming
+    if (! memory_setting_scrollback) {
+        g_object_set_data(G_OBJECT(terminal), "scrollback-untrimmed", NULL);
+    }
+}
+
+gint memory_compare_focus(gconstpointer a, gconstpointer b) {
+    guint x = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(*(VteTerminal**)a), "focus-serial"));
+    guint y = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(*(VteTerminal**)b), "focus-serial"));
+    return x < y ? -1 : x > y;
+}
+
+void memory_check_budget() {
+    if (scrollback_memory_budget <= 0) return;
+
+    gsize budget = (gsize)scrollback_memory_budget * 1024 * 1024;
+    gsize total = 0;
+    GPtrArray* candidates = g_ptr_array_new();
+
+    FOREACH_WINDOW(window) {
+        FOREACH_TAB(tab, window) {
+            FOREACH_TERMINAL(terminal, tab) {
+                total += memory_term_scrollback_bytes(terminal, NULL);
+                // protect anything on screen
+                if (! gtk_widget_get_mapped(GTK_WIDGET(terminal))) {
+                    g_ptr_array_add(candidates, terminal);
+                }
+            }
+        }
+    }
+
+    if (total > budget) {
+        g_ptr_array_sort(candidates, memory_compare_focus);
+
+        gsize excess = total - budget;
+        for (guint i = 0; i < candidates->len && excess > 0; i ++) {
+            VteTerminal* terminal = candidates->pdata[i];
+            glong rows;
+            memory_term_scrollback_bytes(terminal, &rows);
+            gsize row_bytes = memory_row_bytes(terminal);
+
+            glong drop = (excess + row_bytes - 1) / row_bytes;
+            glong keep = MAX(MEMORY_MIN_SCROLLBACK_LINES, rows - drop);
+            if (keep >= rows) continue;
+
+            // let the scrollback log catch up before the rows go
+            scheduler_flush(terminal);
+
+            if (! g_object_get_data(G_OBJECT(terminal), "scrollback-untrimmed")) {
+                int* untrimmed = malloc(sizeof(int));
+                g_object_get(G_OBJECT(terminal), "scrollback-lines", untrimmed, NULL);
+                g_object_set_data_full(G_OBJECT(terminal), "scrollback-untrimmed", untrimmed, free);
+            }
+            // scrollback-lines includes the screen
+            memory_setting_scrollback = TRUE;
+            g_object_set(G_OBJECT(terminal), "scrollback-lines", keep + vte_terminal_get_row_count(terminal), NULL);
+            memory_setting_scrollback = FALSE;
+
+            gsize freed = (rows - keep) * row_bytes;
+            excess -= MIN(excess, freed);
+            memory_trims ++;
+            memory_trimmed_bytes += freed;
+        }
+        memory_reclaim_later();
+    }
+
+    g_ptr_array_free(candidates, TRUE);
+}
+
+gboolean memory_check_timeout(gpointer data) {
+    memory_check_timer = 0;
+    memory_check_budget();
+    return G_SOURCE_REMOVE;
+}
+
+void memory_contents_changed(VteTerminal* terminal) {
+    if (scrollback_memory_budget > 0 && ! memory_check_timer) {
+        memory_check_timer = g_timeout_add_full(G_PRIORITY_LOW, MEMORY_CHECK_DELAY, memory_check_timeout, NULL, NULL);
+    }
+}
+
+void memory_scrollback_stats(GString* output) {
+    gsize total = 0;
+    guint count = 0;
+    FOREACH_WINDOW(window) {
+        FOREACH_TAB(tab, window) {
+            FOREACH_TERMINAL(terminal, tab) {
+                glong rows;
+                int limit;
+                gsize bytes = memory_term_scrollback_bytes(terminal, &rows);
+                g_object_get(G_OBJECT(terminal), "scrollback-lines", &limit, NULL);
+                guint id = term_get_id(terminal);
+
+                g_string_append_printf(output, "scrollback.terminal.%u.rows=%li\n", id, rows);
+                g_string_append_printf(output, "scrollback.terminal.%u.bytes=%zu\n", id, bytes);
+                g_string_append_printf(output, "scrollback.terminal.%u.limit=%i\n", id, limit);
+                g_string_append_printf(output, "scrollback.terminal.%u.trimmed=%i\n", id, g_object_get_data(G_OBJECT(terminal), "scrollback-untrimmed") != NULL);
+                total += bytes;
+                count ++;
+            }
+        }
+    }
+
+    g_string_append_printf(output, "scrollback.budget-bytes=%zu\n", (gsize)MAX(0, scrollback_memory_budget) * 1024 * 1024);
+    g_string_append_printf(output, "scrollback.total-bytes=%zu\n", total);
+    g_string_append_printf(output, "scrollback.terminals=%u\n", count);
+    g_string_append_printf(output, "scrollback.trims=%" G_GUINT64_FORMAT "\n", memory_trims);
+    g_string_append_printf(output, "scrollback.trimmed-bytes=%" G_GUINT64_FORMAT "\n", memory_trimmed_bytes);
+}
+
+void memory_count_widget(GtkWidget* widget, guint* count) {
+    (*count) ++;
+    if (GTK_IS_CONTAINER(widget)) {
+        // include internal children
+        gtk_container_forall(GTK_CONTAINER(widget), (GtkCallback)memory_count_widget, count);
+    }
+}
+
+guint memory_count_widgets(GtkWidget* widget) {
+    guint count = 0;
+    memory_count_widget(widget, &count);
+    return count;
+}
+
+void memory_process_status(GString* output) {
+    // the Vm/Rss lines of /proc/self/status in bytes
+    const char* keys[][2] = {
+        {"VmSize:", "vm-size"},
+        {"VmRSS:", "vm-rss"},
+        {"VmHWM:", "vm-hwm"},
+        {"RssAnon:", "rss-anon"},
+        {"RssFile:", "rss-file"},
+    };
+
+    char* contents = NULL;
+    if (! g_file_get_contents("/proc/self/status", &contents, NULL, NULL)) return;
+
+    for (int i = 0; i < G_N_ELEMENTS(keys); i ++) {
+        char* line = strstr(contents, keys[i][0]);
+        if (line) {
+            guint64 kb = g_ascii_strtoull(line + strlen(keys[i][0]), NULL, 10);
+            g_string_append_printf(output, ",\"%s\":%" G_GUINT64_FORMAT, keys[i][1], kb * 1024);
+        }
+    }
+    g_free(contents);
+}
+
+char* memory_stats_json() {
+    /*
+     * one json object for graphing, sizes are in bytes
+     * windows and tabs are identified by index, terminals by id
+     */
+    GString* output = g_string_new("{\"windows\":[");
+    guint windows = 0, tabs = 0, terminals = 0, widgets = 0;
+    gsize scrollback = 0;
+
+    FOREACH_WINDOW(window) {
+        guint window_widgets = memory_count_widgets(window);
+        widgets += window_widgets;
+        g_string_append_printf(output, "%s{\"index\":%u,\"widgets\":%u,\"tabs\":[", windows ? "," : "", windows, window_widgets);
+
+        int tab_index = 0;
+        FOREACH_TAB(tab, window) {
+            g_string_append_printf(output, "%s{\"index\":%i,\"widgets\":%u,\"title-formatters\":%i,\"terminals\":[",
+                tab_index ? "," : "", tab_index, memory_count_widgets(tab), tab_title_formatter_count(tab));
+
+            gboolean first = TRUE;
+            FOREACH_TERMINAL(terminal, tab) {
+                glong rows;
+                gsize bytes = memory_term_scrollback_bytes(terminal, &rows);
+                g_string_append_printf(output,
+                    "%s{\"id\":%u,\"pid\":%i,\"scrollback-rows\":%li,\"scrollback-bytes\":%zu,\"subprocesses\":%u,\"subprocess-bytes\":%zu}",
+                    first ? "" : ",",
+                    term_get_id(terminal),
+                    get_pid(terminal),
+                    rows,
+                    bytes,
+                    GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(terminal), "subprocesses")),
+                    GPOINTER_TO_SIZE(g_object_get_data(G_OBJECT(terminal), "subprocess-bytes"))
+                );
+                first = FALSE;
+                scrollback += bytes;
+                terminals ++;
+            }
+
+            g_string_append(output, "]}");
+            tab_index ++;
+            tabs ++;
+        }
+
+        g_string_append(output, "]}");
+        windows ++;
+    }
+
+    g_string_append_printf(output,
+        "],\"totals\":{\"windows\":%u,\"tabs\":%u,\"terminals\":%u,\"widgets\":%u,\"scrollback-bytes\":%zu,\"title-formatters\":%i}",
+        windows, tabs, terminals, widgets, scrollback, tab_title_formatter_count(NULL));
+
+    guint buffers;
+    gsize used, reserved;
+    buffer_stats(&buffers, &used, &reserved);
+    g_string_append_printf(output, ",\"socket-buffers\":{\"count\":%u,\"used-bytes\":%zu,\"reserved-bytes\":%zu}", buffers, used, reserved);
+
+    // __GLIBC_PREREQ is not defined elsewhere (e.g. musl) so it cannot share the #if
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 info = mallinfo2();
+    g_string_append_printf(output, ",\"malloc\":{\"arena\":%zu,\"mmap\":%zu,\"in-use\":%zu,\"free\":%zu,\"releasable\":%zu}",
+        info.arena, info.hblkhd, info.uordblks, info.fordblks, info.keepcost);
+#endif
+#endif
+
+    g_string_append_printf(output, ",\"process\":{\"pid\":%i", getpid());
+    memory_process_status(output);
+    g_string_append(output, "}}\n");
+
+    return g_string_free(output, FALSE);
+}
+
+/*
+ * memory-reclaim
+ * glibc holds on to freed memory, so after tabs/terminals are destroyed or a
+ * large export, trim the heap and release what we cache once things go quiet
+ */
+
+guint memory_reclaim_timer = 0;
+
+// counters
+guint64 memory_reclaim_passes = 0;
+guint64 memory_reclaimed_rss = 0;
+gint64 memory_reclaimed_last_rss = 0;
+guint64 memory_reclaimed_heap = 0;
+guint64 memory_reclaimed_buffers = 0;
+guint64 memory_reclaimed_regexes = 0;
+
+gsize memory_rss() {
+    unsigned long pages = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file) {
+        if (fscanf(file, "%*u %lu", &pages) != 1) pages = 0;
+        fclose(file);
+    }
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+gsize memory_heap() {
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.arena + info.hblkhd;
+#endif
+#endif
+    return 0;
+}
+
+void memory_reclaim_now() {
+    gsize rss = memory_rss();
+    gsize heap = memory_heap();
+
+    if (memory_reclaim == MEMORY_RECLAIM_AGGRESSIVE) {
+        memory_reclaimed_regexes += regex_cache_clear();
+    }
+    memory_reclaimed_buffers += buffer_shrink_all(memory_reclaim == MEMORY_RECLAIM_AGGRESSIVE ? BUFFER_DEFAULT_SIZE : MEMORY_RECLAIM_BUFFER_SIZE);
+    malloc_trim(0);
+
+    memory_reclaim_passes ++;
+    memory_reclaimed_last_rss = (gint64)rss - (gint64)memory_rss();
+    memory_reclaimed_rss += MAX(0, memory_reclaimed_last_rss);
+    memory_reclaimed_heap += heap - MIN(heap, memory_heap());
+}
+
+gboolean memory_reclaim_timeout(gpointer data) {
+    memory_reclaim_timer = 0;
+    memory_reclaim_now();
+    return G_SOURCE_REMOVE;
+}
+
+void memory_reclaim_later() {
+    if (memory_reclaim == MEMORY_RECLAIM_OFF) return;
+    // coalesce e.g. closing a whole window into one pass
+    if (memory_reclaim_timer) g_source_remove(memory_reclaim_timer);
+    memory_reclaim_timer = g_timeout_add_full(G_PRIORITY_LOW, MEMORY_RECLAIM_DELAY, memory_reclaim_timeout, NULL, NULL);
+}
+
+void memory_reclaim_stats(GString* output) {
+    const char* modes[] = {"off", "normal", "aggressive"};
+    g_string_append_printf(output, "reclaim.mode=%s\n", modes[CLAMP(memory_reclaim, 0, G_N_ELEMENTS(modes)-1)]);
+    g_string_append_printf(output, "reclaim.pending=%i\n", memory_reclaim_timer != 0);
+    g_string_append_printf(output, "reclaim.passes=%" G_GUINT64_FORMAT "\n", memory_reclaim_passes);
+    g_string_append_printf(output, "reclaim.rss-bytes=%" G_GUINT64_FORMAT "\n", memory_reclaimed_rss);
+    g_string_append_printf(output, "reclaim.last-rss-bytes=%" G_GINT64_FORMAT "\n", memory_reclaimed_last_rss);
+    g_string_append_printf(output, "reclaim.heap-bytes=%" G_GUINT64_FORMAT "\n", memory_reclaimed_heap);
+    g_string_append_printf(output, "reclaim.buffer-bytes=%" G_GUINT64_FORMAT "\n", memory_reclaimed_buffers);
+    g_string_append_printf(output, "reclaim.regexes=%" G_GUINT64_FORMAT "\n", memory_reclaimed_regexes);
+}
@@ -0,0 +1,33 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <vte/vte.h>
+
+// check the scrollback budget at most this often while there is output
+#define MEMORY_CHECK_DELAY 1000
+// never trim a terminal below this many lines of scrollback
+#define MEMORY_MIN_SCROLLBACK_LINES 100
+// approximate bytes per scrollback row on top of one per column
+#define MEMORY_ROW_OVERHEAD 16
+
+#define MEMORY_RECLAIM_OFF 0
+#define MEMORY_RECLAIM_NORMAL 1
+#define MEMORY_RECLAIM_AGGRESSIVE 2
+// reclaim this long after the last thing was destroyed
+#define MEMORY_RECLAIM_DELAY 2000
+// exports at least this big are followed by a reclaim
+#define MEMORY_RECLAIM_LARGE_EXPORT (1024*1024)
+// in normal mode, connection buffers bigger than this are shrunk
+#define MEMORY_RECLAIM_BUFFER_SIZE (64*1024)
+
+gsize memory_term_scrollback_bytes(VteTerminal* terminal, glong* rows);
+void memory_touch(VteTerminal* terminal);
+void memory_scrollback_lines_changed(VteTerminal* terminal, GParamSpec* pspec);
+void memory_contents_changed(VteTerminal* terminal);
+void memory_check_budget();
+void memory_scrollback_stats(GString* output);
+char* memory_stats_json();
+void memory_reclaim_later();
+void memory_reclaim_stats(GString* output);
+
+#endif
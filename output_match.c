@@ -0,0 +1,194 @@
+#include <string.h>
+#include "output_match.h"
+#include "terminal.h"
+#include "config.h"
+#include "action.h"
+#include "utils.h"
+
+/*
+ * on-output-match-<name> = <regex> => <action>
+ * only rows that have been committed since the last check get matched (up to but excluding the cursor row)
+ * the patterns are combined into one regex first
+ * so that in the common case of nothing matching, the text is only scanned once
+ * patterns with capture groups or backreferences are left out as combining them
+ * renumbers the groups, those are always matched on their own
+ */
+
+typedef struct {
+    guint id;
+    char* name;
+    GRegex* regex;
+    // covered by the combined regex
+    gboolean combined;
+} OutputMatch;
+
+GPtrArray* output_matches = NULL;
+GRegex* output_match_combined = NULL;
+gboolean output_match_combined_dirty = FALSE;
+const char* output_match_text = NULL;
+
+void output_match_free(OutputMatch* match) {
+    free(match->name);
+    if (match->regex) g_regex_unref(match->regex);
+    free(match);
+}
+
+OutputMatch* output_match_lookup(const char* name, gboolean create) {
+    if (! output_matches) {
+        if (! create) return NULL;
+        output_matches = g_ptr_array_new_with_free_func((GDestroyNotify)output_match_free);
+    }
+
+    for (guint i = 0; i < output_matches->len; i ++) {
+        OutputMatch* match = output_matches->pdata[i];
+        if (STR_EQUAL(match->name, name)) return match;
+    }
+    if (! create) return NULL;
+
+    /*
+     * take the lowest free id, bindings are removed along with their match so reuse is safe
+     * and this keeps OUTPUT_MATCH_EVENT_BASE + id clear of the key bindings in the same table
+     * however many times the config is reloaded
+     */
+    guint id = 0;
+    for (guint i = 0; i < output_matches->len; ) {
+        if (((OutputMatch*)output_matches->pdata[i])->id == id) {
+            id ++;
+            i = 0;
+        } else {
+            i ++;
+        }
+    }
+    OutputMatch* match = calloc(1, sizeof(OutputMatch));
+    match->id = id;
+    match->name = strdup(name);
+    g_ptr_array_add(output_matches, match);
+    return match;
+}
+
+gboolean output_match_set(const char* name, char* value) {
+    OutputMatch* match;
+
+    if (STR_EQUAL(value, "")) {
+        // unset
+        match = output_match_lookup(name, FALSE);
+        if (match) {
+            remove_action_binding(EVENT_KEY, OUTPUT_MATCH_EVENT_BASE + match->id);
+            g_ptr_array_remove(output_matches, match);
+            output_match_combined_dirty = TRUE;
+        }
+        return TRUE;
+    }
+
+    char* separator = strstr(value, " => ");
+    if (! separator) {
+        g_warning("Expected <regex> => <action>: %s", value);
+        return FALSE;
+    }
+    *separator = '\0';
+    char* pattern = g_strstrip(value);
+    char* action_str = g_strstrip(separator + sizeof(" => ") - 1);
+
+    GError* error = NULL;
+    GRegex* regex = g_regex_new(pattern, G_REGEX_OPTIMIZE | G_REGEX_MULTILINE, 0, &error);
+    if (error) {
+        g_warning("%s: %s", error->message, pattern);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    Action action = lookup_action(action_str);
+    if (! action.func) {
+        g_warning("Unrecognised action: %s", action_str);
+        g_regex_unref(regex);
+        return FALSE;
+    }
+
+    match = output_match_lookup(name, TRUE);
+    if (match->regex) g_regex_unref(match->regex);
+    match->regex = regex;
+    // redefining a name replaces it
+    remove_action_binding(EVENT_KEY, OUTPUT_MATCH_EVENT_BASE + match->id);
+    add_action_binding(EVENT_KEY, OUTPUT_MATCH_EVENT_BASE + match->id, action);
+    output_match_combined_dirty = TRUE;
+    return TRUE;
+}
+
+void output_match_reset() {
+    // action bindings are removed separately
+    if (output_matches) g_ptr_array_set_size(output_matches, 0);
+    output_match_combined_dirty = TRUE;
+}
+
+GRegex* output_match_get_combined() {
+    if (! output_match_combined_dirty) return output_match_combined;
+    output_match_combined_dirty = FALSE;
+
+    if (output_match_combined) g_regex_unref(output_match_combined);
+    output_match_combined = NULL;
+    if (! output_matches || ! output_matches->len) return NULL;
+
+    GString* combined = g_string_new(NULL);
+    for (guint i = 0; i < output_matches->len; i ++) {
+        OutputMatch* match = output_matches->pdata[i];
+        match->combined = g_regex_get_capture_count(match->regex) == 0 && g_regex_get_max_backref(match->regex) == 0;
+        if (match->combined) {
+            g_string_append_printf(combined, "%s(?:%s)", combined->len ? "|" : "", g_regex_get_pattern(match->regex));
+        }
+    }
+
+    GError* error = NULL;
+    if (combined->len) {
+        output_match_combined = g_regex_new(combined->str, G_REGEX_OPTIMIZE | G_REGEX_MULTILINE, 0, &error);
+    }
+    if (error) {
+        // match them all one at a time instead
+        g_error_free(error);
+        for (guint i = 0; i < output_matches->len; i ++) {
+            ((OutputMatch*)output_matches->pdata[i])->combined = FALSE;
+        }
+    }
+    g_string_free(combined, TRUE);
+    return output_match_combined;
+}
+
+void output_match_run(VteTerminal* terminal, guint id, GRegex* regex, const char* text) {
+    GMatchInfo* info;
+    g_regex_match(regex, text, 0, &info);
+    while (g_match_info_matches(info)) {
+        char* string = g_match_info_fetch(info, 0);
+        output_match_text = string;
+        trigger_action(terminal, EVENT_KEY, OUTPUT_MATCH_EVENT_BASE + id);
+        output_match_text = NULL;
+        g_free(string);
+        g_match_info_next(info, NULL);
+    }
+    g_match_info_free(info);
+}
+
+void output_match_contents_changed(VteTerminal* terminal) {
+    glong start, end;
+    if (! term_get_committed_rows(terminal, "output-watermark", &start, &end)) return;
+    if (! output_matches || ! output_matches->len) return;
+
+    char* text = vte_terminal_get_text_range(terminal, start, 0, end, -1, NULL, NULL, NULL);
+    if (! text) return;
+
+    GRegex* combined = output_match_get_combined();
+    gboolean prefiltered = combined && g_regex_match(combined, text, 0, NULL);
+
+    // the actions may change the bindings (e.g. reload_config), so work on a copy
+    guint n = output_matches->len;
+    OutputMatch matches[n];
+    for (guint i = 0; i < n; i ++) {
+        matches[i] = *(OutputMatch*)output_matches->pdata[i];
+        g_regex_ref(matches[i].regex);
+    }
+    for (guint i = 0; i < n; i ++) {
+        if (prefiltered || ! matches[i].combined) {
+            output_match_run(terminal, matches[i].id, matches[i].regex, text);
+        }
+        g_regex_unref(matches[i].regex);
+    }
+    free(text);
+}
@@ -0,0 +1,16 @@
+#ifndef OUTPUT_MATCH_H
+#define OUTPUT_MATCH_H
+
+#include <vte/vte.h>
+
+// event metadata for on-output-match-* bindings is this + the id of the name
+#define OUTPUT_MATCH_EVENT_BASE 0x100
+
+// the matched text of the on-output-match-* binding currently running, if any
+const char* output_match_text;
+
+gboolean output_match_set(const char* name, char* value);
+void output_match_reset();
+void output_match_contents_changed(VteTerminal* terminal);
+
+#endif
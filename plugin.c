@@ -0,0 +1,181 @@
+#include <gmodule.h>
+#include <string.h>
+#include "plugin_api.h"
+#include "plugin.h"
+#include "terminal.h"
+#include "config.h"
+#include "utils.h"
+
+/*
+ * native plugins, see plugin_api.h
+ * plugins are never unloaded, reloading the config does not reload them
+ */
+
+typedef struct {
+    ActionMetadata metadata;
+    TermineurEventFunc func;
+    gpointer user_data;
+} PluginEventHandler;
+
+typedef struct {
+    char* name;
+    TermineurTitleFieldFunc func;
+} PluginTitleField;
+
+GHashTable* plugin_modules = NULL;
+GHashTable* plugin_actions = NULL;
+GArray* plugin_event_handlers = NULL;
+PluginTitleField plugin_title_fields_list[PLUGIN_MAX_TITLE_FIELDS];
+int plugin_title_field_count = 0;
+
+struct {
+    const char* name;
+    ActionMetadata metadata;
+} plugin_events[] = {
+    {"bell", BELL_EVENT},
+    {"hyperlink-hover", HYPERLINK_HOVER_EVENT},
+    {"hyperlink-click", HYPERLINK_CLICK_EVENT},
+    {"focus", FOCUS_IN_EVENT},
+    {"start", START_EVENT},
+    {"config", CONFIG_LOAD_EVENT},
+};
+
+gboolean plugin_register_action(const char* name, TermineurActionFunc func) {
+    if (! plugin_actions) {
+        plugin_actions = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    }
+    g_hash_table_insert(plugin_actions, strdup(name), func);
+    return TRUE;
+}
+
+gboolean plugin_register_event_handler(const char* event, TermineurEventFunc func, gpointer user_data) {
+    for (int i = 0; i < G_N_ELEMENTS(plugin_events); i ++) {
+        if (STR_EQUAL(event, plugin_events[i].name)) {
+            if (! plugin_event_handlers) {
+                plugin_event_handlers = g_array_new(FALSE, FALSE, sizeof(PluginEventHandler));
+            }
+            PluginEventHandler handler = {plugin_events[i].metadata, func, user_data};
+            g_array_append_val(plugin_event_handlers, handler);
+            return TRUE;
+        }
+    }
+    g_warning("Unknown plugin event: %s", event);
+    return FALSE;
+}
+
+gboolean plugin_register_title_field(const char* name, TermineurTitleFieldFunc func) {
+    int index = plugin_title_field_index(name);
+    if (index < 0) {
+        if (plugin_title_field_count >= PLUGIN_MAX_TITLE_FIELDS) {
+            g_warning("Too many plugin title fields: %s", name);
+            return FALSE;
+        }
+        index = plugin_title_field_count ++;
+        plugin_title_fields_list[index].name = strdup(name);
+    }
+    plugin_title_fields_list[index].func = func;
+    return TRUE;
+}
+
+void plugin_execute_line_async(char* line, int size, TermineurResultFunc callback, gpointer user_data) {
+    gboolean deferred;
+    char* result = execute_line_deferred(line, size, (DeferredResultFunc)callback, user_data, &deferred);
+    if (! deferred) callback(result, user_data);
+}
+
+const TermineurHost plugin_host = {
+    TERMINEUR_PLUGIN_ABI_VERSION,
+    plugin_register_action,
+    plugin_register_event_handler,
+    plugin_register_title_field,
+    term_get_text,
+    execute_line,
+    plugin_execute_line_async,
+};
+
+gboolean plugin_load(const char* path) {
+    if (! g_module_supported()) {
+        g_warning("Plugins are not supported");
+        return FALSE;
+    }
+
+    if (! plugin_modules) {
+        plugin_modules = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    }
+    // already loaded
+    if (g_hash_table_contains(plugin_modules, path)) return TRUE;
+
+    GModule* module = g_module_open(path, G_MODULE_BIND_LOCAL);
+    if (! module) {
+        g_warning("Failed to load plugin %s: %s", path, g_module_error());
+        return FALSE;
+    }
+
+    const guint* version = NULL;
+    TermineurPluginInitFunc init = NULL;
+    if (! g_module_symbol(module, "termineur_plugin_abi_version", (gpointer*)&version) || ! version) {
+        g_warning("Plugin %s does not export termineur_plugin_abi_version", path);
+    } else if (*version != TERMINEUR_PLUGIN_ABI_VERSION) {
+        g_warning("Plugin %s is for ABI version %u, expected %u", path, *version, TERMINEUR_PLUGIN_ABI_VERSION);
+    } else if (! g_module_symbol(module, "termineur_plugin_init", (gpointer*)&init) || ! init) {
+        g_warning("Plugin %s does not export termineur_plugin_init", path);
+    } else if (! init(&plugin_host)) {
+        g_warning("Plugin %s failed to initialise", path);
+    } else {
+        // keep it loaded for good
+        g_module_make_resident(module);
+        g_hash_table_add(plugin_modules, strdup(path));
+        return TRUE;
+    }
+
+    g_module_close(module);
+    return FALSE;
+}
+
+gboolean plugin_make_action(Action* action, const char* name, char* arg) {
+    TermineurActionFunc func = plugin_actions ? g_hash_table_lookup(plugin_actions, name) : NULL;
+    if (! func) return FALSE;
+
+    action->func = (ActionFunc)func;
+    if (arg && *(arg = g_strstrip(arg))) {
+        action->data = strdup(arg);
+        action->cleanup = free;
+    }
+    return TRUE;
+}
+
+int plugin_trigger_event(VteTerminal* terminal, ActionMetadata metadata) {
+    int handled = 0;
+    if (! plugin_event_handlers) return handled;
+
+    for (int i = 0; i < plugin_event_handlers->len; i ++) {
+        PluginEventHandler* handler = &g_array_index(plugin_event_handlers, PluginEventHandler, i);
+        if (handler->metadata != metadata) continue;
+
+        for (int j = 0; j < G_N_ELEMENTS(plugin_events); j ++) {
+            if (plugin_events[j].metadata == metadata) {
+                handler->func(terminal, plugin_events[j].name, handler->user_data);
+                handled = 1;
+                break;
+            }
+        }
+    }
+    return handled;
+}
+
+int plugin_title_field_index(const char* name) {
+    for (int i = 0; i < plugin_title_field_count; i ++) {
+        if (STR_EQUAL(plugin_title_fields_list[i].name, name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void plugin_title_fields(VteTerminal* terminal, char* fields[PLUGIN_MAX_TITLE_FIELDS]) {
+    // fills in malloc'd strings, never NULL
+    for (int i = 0; i < PLUGIN_MAX_TITLE_FIELDS; i ++) {
+        char* value = i < plugin_title_field_count ? plugin_title_fields_list[i].func(terminal) : NULL;
+        fields[i] = value ? value : strdup("");
+    }
+}
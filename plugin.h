@@ -0,0 +1,15 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include "action.h"
+
+// plugin title fields are passed to the title format as %6$s onwards
+#define PLUGIN_MAX_TITLE_FIELDS 4
+
+gboolean plugin_load(const char* path);
+gboolean plugin_make_action(Action* action, const char* name, char* arg);
+int plugin_trigger_event(VteTerminal* terminal, ActionMetadata metadata);
+int plugin_title_field_index(const char* name);
+void plugin_title_fields(VteTerminal* terminal, char* fields[PLUGIN_MAX_TITLE_FIELDS]);
+
+#endif
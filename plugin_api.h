@@ -0,0 +1,48 @@
+#ifndef PLUGIN_API_H
+#define PLUGIN_API_H
+
+/*
+ * the C ABI for native plugins loaded with load-plugin
+ * a plugin is a shared library exporting:
+ *
+ *      const guint termineur_plugin_abi_version = TERMINEUR_PLUGIN_ABI_VERSION;
+ *      gboolean termineur_plugin_init(const TermineurHost* host);
+ *
+ * bump the version on *any* incompatible change to this file
+ * only ever append fields to TermineurHost
+ */
+
+#include <vte/vte.h>
+
+#define TERMINEUR_PLUGIN_ABI_VERSION 1
+
+// arg is the text after the colon, or NULL; set *result (malloc'd) only if result is not NULL
+typedef void(*TermineurActionFunc)(VteTerminal* terminal, const char* arg, char** result);
+// event is e.g. "bell", "focus", "hyperlink-click"
+typedef void(*TermineurEventFunc)(VteTerminal* terminal, const char* event, gpointer user_data);
+// return a malloc'd string, or NULL for empty
+typedef char*(*TermineurTitleFieldFunc)(VteTerminal* terminal);
+// result is malloc'd (or NULL) and owned by the callback
+typedef void(*TermineurResultFunc)(char* result, gpointer user_data);
+
+typedef struct {
+    guint abi_version;
+
+    // usable as `name: arg` anywhere actions are, e.g. on-key-* or over the socket
+    gboolean (*register_action)(const char* name, TermineurActionFunc func);
+    gboolean (*register_event_handler)(const char* event, TermineurEventFunc func, gpointer user_data);
+    // usable as %{name} in tab-label-format, window-title-format, tab-title-ui
+    gboolean (*register_title_field)(const char* name, TermineurTitleFieldFunc func);
+
+    // helpers
+    char* (*get_text)(VteTerminal* terminal, glong start_row, glong start_col, glong end_row, glong end_col, gboolean ansi);
+    // run a config line or action, returns any (malloc'd) result
+    void* (*execute_line)(char* line, int size, gboolean reconfigure, gboolean do_actions);
+    // same, but the result goes to callback, which also works for actions that finish later (e.g. search_all)
+    // callback may be called before this returns
+    void (*execute_line_async)(char* line, int size, TermineurResultFunc callback, gpointer user_data);
+} TermineurHost;
+
+typedef gboolean(*TermineurPluginInitFunc)(const TermineurHost* host);
+
+#endif
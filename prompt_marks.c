@@ -0,0 +1,109 @@
+#include <gtk/gtk.h>
+#include "prompt_marks.h"
+#include "terminal.h"
+#include "utils.h"
+
+/*
+ * index of where each prompt, command and its output starts + ends
+ * from semantic prompt (OSC 133) markers
+ * vte parses these and reports them as the vte.shell.* termprops
+ */
+
+GArray* prompt_marks_get(VteTerminal* terminal) {
+    GArray* marks = g_object_get_data(G_OBJECT(terminal), "prompt-marks");
+    if (! marks) return NULL;
+
+    // rewrapping renumbers the rows in ways that cannot be followed, so start over
+    glong columns = vte_terminal_get_column_count(terminal);
+    if (columns != GPOINTER_TO_INT(g_object_get_data(G_OBJECT(terminal), "prompt-marks-columns"))) {
+        gboolean rewrap;
+        g_object_get(G_OBJECT(terminal), "rewrap-on-resize", &rewrap, NULL);
+        if (rewrap) g_array_set_size(marks, 0);
+        g_object_set_data(G_OBJECT(terminal), "prompt-marks-columns", GINT_TO_POINTER(columns));
+    }
+
+    // forget anything that has scrolled out of the scrollback
+    int lower;
+    term_get_row_positions(terminal, NULL, NULL, &lower, NULL);
+    guint trimmed = 0;
+    while (trimmed < marks->len && g_array_index(marks, CommandMark, trimmed).prompt_row < lower) {
+        trimmed ++;
+    }
+    g_array_remove_range(marks, 0, trimmed);
+    return marks;
+}
+
+#if VTE_CHECK_VERSION(0, 78, 0)
+void prompt_marks_termprop_changed(VteTerminal* terminal, const char* name) {
+    GArray* marks = prompt_marks_get(terminal);
+    glong row, col;
+    vte_terminal_get_cursor_position(terminal, &col, &row);
+    CommandMark* last = marks->len ? &g_array_index(marks, CommandMark, marks->len-1) : NULL;
+
+    if (STR_EQUAL(name, VTE_TERMPROP_SHELL_PRECMD)) {
+        // a new prompt
+        if (last && last->output_row >= 0 && last->end_row < 0) {
+            last->end_row = row;
+        }
+        CommandMark mark = {row, -1, -1};
+        g_array_append_val(marks, mark);
+
+    } else if (last && STR_EQUAL(name, VTE_TERMPROP_SHELL_PREEXEC)) {
+        // the command is starting, output comes after this
+        last->output_row = row;
+        last->end_row = -1;
+
+    } else if (last && last->output_row >= 0 && STR_EQUAL(name, VTE_TERMPROP_SHELL_POSTEXEC)) {
+        // a partially written row is still output
+        last->end_row = row + (col > 0 ? 1 : 0);
+    }
+}
+#endif
+
+void prompt_marks_init(VteTerminal* terminal) {
+#if VTE_CHECK_VERSION(0, 78, 0)
+    GArray* marks = g_array_new(FALSE, FALSE, sizeof(CommandMark));
+    g_object_set_data_full(G_OBJECT(terminal), "prompt-marks", marks, (GDestroyNotify)g_array_unref);
+    g_object_set_data(G_OBJECT(terminal), "prompt-marks-columns", GINT_TO_POINTER(vte_terminal_get_column_count(terminal)));
+    g_signal_connect(terminal, "termprop-changed", G_CALLBACK(prompt_marks_termprop_changed), NULL);
+#endif
+}
+
+void prompt_marks_reset(VteTerminal* terminal) {
+    // e.g. after the scrollback was cleared and rows are numbered from 0 again
+    GArray* marks = g_object_get_data(G_OBJECT(terminal), "prompt-marks");
+    if (marks) g_array_set_size(marks, 0);
+}
+
+CommandMark* prompt_marks_last_output(VteTerminal* terminal) {
+    // the most recent command that has finished, if any
+    GArray* marks = prompt_marks_get(terminal);
+    if (! marks) return NULL;
+
+    for (int i = marks->len - 1; i >= 0; i --) {
+        CommandMark* mark = &g_array_index(marks, CommandMark, i);
+        if (mark->output_row >= 0 && mark->end_row >= 0) {
+            return mark;
+        }
+    }
+    return NULL;
+}
+
+glong prompt_marks_find(VteTerminal* terminal, glong row, int direction) {
+    // row of the nearest prompt before (direction < 0) or after row, or -1
+    GArray* marks = prompt_marks_get(terminal);
+    if (! marks) return -1;
+
+    if (direction < 0) {
+        for (int i = marks->len - 1; i >= 0; i --) {
+            glong prompt = g_array_index(marks, CommandMark, i).prompt_row;
+            if (prompt < row) return prompt;
+        }
+    } else {
+        for (int i = 0; i < marks->len; i ++) {
+            glong prompt = g_array_index(marks, CommandMark, i).prompt_row;
+            if (prompt > row) return prompt;
+        }
+    }
+    return -1;
+}
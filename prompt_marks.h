@@ -0,0 +1,19 @@
+#ifndef PROMPT_MARKS_H
+#define PROMPT_MARKS_H
+
+#include <vte/vte.h>
+
+typedef struct {
+    glong prompt_row;
+    // -1 until known
+    glong output_row;
+    // exclusive
+    glong end_row;
+} CommandMark;
+
+void prompt_marks_init(VteTerminal* terminal);
+void prompt_marks_reset(VteTerminal* terminal);
+CommandMark* prompt_marks_last_output(VteTerminal* terminal);
+glong prompt_marks_find(VteTerminal* terminal, glong row, int direction);
+
+#endif
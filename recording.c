@@ -0,0 +1,378 @@
+#include <gtk/gtk.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include "recording.h"
+#include "terminal.h"
+#include "utils.h"
+
+/*
+ * record_rows writes rows to an asciicast v2 file as they are completed
+ * and replay plays back any asciicast v2 file, e.g. one made by asciinema
+ * replaying as fast as possible doubles as a rendering benchmark
+ *
+ * vte does not expose the raw pty output, so this is not a recording of the session:
+ * rows are serialized back into ansi with colours only, without cursor movement,
+ * the alternate screen or any other escape sequences
+ * use asciinema for real sessions (and benchmarks of them)
+ */
+
+typedef struct {
+    FILE* file;
+    GAsyncQueue* queue;
+    gint64 start_time;
+} Recording;
+
+typedef struct {
+    double time;
+    char* data;
+    gsize length;
+} ReplayEvent;
+
+typedef struct {
+    VteTerminal* terminal;
+    GArray* events;
+    guint next;
+    // 0 means as fast as possible
+    double speed;
+    gint64 start_time;
+    gsize bytes;
+    guint source;
+
+    // stats
+    guint probe;
+    gint64 last_probe;
+    GArray* stalls;
+    GdkFrameClock* clock;
+    gulong paint_handler;
+    gulong paint_start_handler;
+    guint frames;
+    // time spent painting each frame
+    gint64 paint_start;
+    GArray* paints;
+} Replay;
+
+// tells the writer thread to stop
+char record_stop_line;
+
+void json_escape(GString* output, const char* text) {
+    g_string_append_c(output, '"');
+    for (const char* p = text; *p; p++) {
+        switch (*p) {
+            case '"': g_string_append(output, "\\\""); break;
+            case '\\': g_string_append(output, "\\\\"); break;
+            case '\n': g_string_append(output, "\\n"); break;
+            case '\r': g_string_append(output, "\\r"); break;
+            case '\t': g_string_append(output, "\\t"); break;
+            default:
+                if ((unsigned char)*p < 0x20) {
+                    g_string_append_printf(output, "\\u%04x", *p);
+                } else {
+                    g_string_append_c(output, *p);
+                }
+        }
+    }
+    g_string_append_c(output, '"');
+}
+
+const char* json_parse_string(const char* p, GString* output) {
+    // returns the position after the closing quote or NULL if invalid
+    while (g_ascii_isspace(*p)) p++;
+    if (*p++ != '"') return NULL;
+
+    for (; *p != '"'; p++) {
+        if (! *p) return NULL;
+        if (*p != '\\') {
+            g_string_append_c(output, *p);
+            continue;
+        }
+
+        switch (*++p) {
+            case 'n': g_string_append_c(output, '\n'); break;
+            case 'r': g_string_append_c(output, '\r'); break;
+            case 't': g_string_append_c(output, '\t'); break;
+            case 'b': g_string_append_c(output, '\b'); break;
+            case 'f': g_string_append_c(output, '\f'); break;
+            case 'u': {
+                char hex[5] = {0};
+                if (strlen(p+1) < 4) return NULL;
+                memcpy(hex, p+1, 4);
+                gunichar c = strtoul(hex, NULL, 16);
+                p += 4;
+                // surrogate pair
+                if (c >= 0xd800 && c < 0xdc00 && p[1] == '\\' && p[2] == 'u' && strlen(p+3) >= 4) {
+                    memcpy(hex, p+3, 4);
+                    gunichar low = strtoul(hex, NULL, 16);
+                    if (low >= 0xdc00 && low < 0xe000) {
+                        c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+                        p += 6;
+                    }
+                }
+                g_string_append_unichar(output, c);
+                break;
+            }
+            case '\0': return NULL;
+            // \" \\ \/
+            default: g_string_append_c(output, *p);
+        }
+    }
+    return p+1;
+}
+
+gpointer record_writer(Recording* recording) {
+    // owns the recording once told to stop, so the main thread never waits on the disk
+    char* line;
+    while ((line = g_async_queue_pop(recording->queue)) != &record_stop_line) {
+        fputs(line, recording->file);
+        free(line);
+    }
+    g_async_queue_unref(recording->queue);
+    fclose(recording->file);
+    free(recording);
+    return NULL;
+}
+
+void recording_free(Recording* recording) {
+    // the writer finishes off what is queued and frees it
+    g_async_queue_push(recording->queue, &record_stop_line);
+}
+
+gboolean record_start(VteTerminal* terminal, const char* filename) {
+    record_stop(terminal);
+
+    FILE* file = fopen(filename, "w");
+    if (! file) {
+        g_warning("Failed to open %s: %s", filename, strerror(errno));
+        return FALSE;
+    }
+
+    Recording* recording = malloc(sizeof(Recording));
+    recording->file = file;
+    recording->queue = g_async_queue_new();
+    recording->start_time = g_get_monotonic_time();
+    g_thread_unref(g_thread_new("record", (GThreadFunc)record_writer, recording));
+
+    char* header = g_strdup_printf(
+        "{\"version\": 2, \"width\": %li, \"height\": %li, \"timestamp\": %" G_GINT64_FORMAT ", \"title\": \"completed rows, not raw pty output\"}\n",
+        vte_terminal_get_column_count(terminal),
+        vte_terminal_get_row_count(terminal),
+        g_get_real_time() / G_USEC_PER_SEC
+    );
+    g_async_queue_push(recording->queue, header);
+
+    // only record from here on
+    glong start, end;
+    term_get_committed_rows(terminal, "record-watermark", &start, &end);
+    g_object_set_data_full(G_OBJECT(terminal), "recording", recording, (GDestroyNotify)recording_free);
+    return TRUE;
+}
+
+void record_stop(VteTerminal* terminal) {
+    g_object_set_data(G_OBJECT(terminal), "recording", NULL);
+}
+
+void recording_contents_changed(VteTerminal* terminal) {
+    Recording* recording = g_object_get_data(G_OBJECT(terminal), "recording");
+    if (! recording) return;
+
+    glong start, end;
+    if (! term_get_committed_rows(terminal, "record-watermark", &start, &end)) return;
+    char* text = term_get_text(terminal, start, 0, end, -1, TRUE);
+    if (! text) return;
+
+    // the rows come back with bare newlines
+    char** lines = g_strsplit(text, "\n", -1);
+    char* data = g_strjoinv("\r\n", lines);
+    g_strfreev(lines);
+    free(text);
+
+    GString* line = g_string_new(NULL);
+    g_string_append_printf(line, "[%.6f, \"o\", ", (g_get_monotonic_time() - recording->start_time) / (double)G_USEC_PER_SEC);
+    json_escape(line, data);
+    g_string_append(line, "]\n");
+    g_free(data);
+    g_async_queue_push(recording->queue, g_string_free(line, FALSE));
+}
+
+gint compare_int64(const gint64* a, const gint64* b) {
+    return *a < *b ? -1 : *a > *b;
+}
+
+double percentile_ms(GArray* values, int p) {
+    // values must be sorted
+    return values->len ? g_array_index(values, gint64, (values->len-1) * p / 100) / 1000. : 0;
+}
+
+void replay_report(Replay* replay) {
+    double elapsed = (g_get_monotonic_time() - replay->start_time) / (double)G_USEC_PER_SEC;
+    g_array_sort(replay->stalls, (GCompareFunc)compare_int64);
+    g_array_sort(replay->paints, (GCompareFunc)compare_int64);
+
+    char* message = g_strdup_printf(
+        "replay: %zu bytes in %.2fs (%.2f MB/s), %u frames (%.1f fps), "
+        "paint p50=%.2fms p90=%.2fms p99=%.2fms max=%.2fms, "
+        "stalls p50=%.1fms p90=%.1fms p99=%.1fms max=%.1fms",
+        replay->bytes, elapsed, replay->bytes / elapsed / 1e6,
+        replay->frames, replay->frames / elapsed,
+        percentile_ms(replay->paints, 50), percentile_ms(replay->paints, 90), percentile_ms(replay->paints, 99), percentile_ms(replay->paints, 100),
+        percentile_ms(replay->stalls, 50), percentile_ms(replay->stalls, 90), percentile_ms(replay->stalls, 99), percentile_ms(replay->stalls, 100)
+    );
+
+    g_message("%s", message);
+    term_show_message_bar(replay->terminal, message, -1);
+    free(message);
+}
+
+void replay_free(Replay* replay) {
+    if (replay->source) g_source_remove(replay->source);
+    if (replay->probe) g_source_remove(replay->probe);
+    if (replay->paint_handler) g_signal_handler_disconnect(replay->clock, replay->paint_handler);
+    if (replay->paint_start_handler) g_signal_handler_disconnect(replay->clock, replay->paint_start_handler);
+    for (guint i = 0; i < replay->events->len; i ++) {
+        free(g_array_index(replay->events, ReplayEvent, i).data);
+    }
+    g_array_free(replay->events, TRUE);
+    g_array_free(replay->stalls, TRUE);
+    g_array_free(replay->paints, TRUE);
+    free(replay);
+}
+
+void replay_paint(GdkFrameClock* clock, Replay* replay) {
+    replay->paint_start = g_get_monotonic_time();
+}
+
+void replay_frame(GdkFrameClock* clock, Replay* replay) {
+    replay->frames ++;
+    if (replay->paint_start) {
+        gint64 paint = g_get_monotonic_time() - replay->paint_start;
+        g_array_append_val(replay->paints, paint);
+        replay->paint_start = 0;
+    }
+}
+
+gboolean replay_probe(Replay* replay) {
+    // how late we are is how long the main loop was busy for
+    gint64 now = g_get_monotonic_time();
+    gint64 stall = now - replay->last_probe - REPLAY_PROBE_INTERVAL * 1000;
+    g_array_append_val(replay->stalls, stall);
+    replay->last_probe = now;
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean replay_step(Replay* replay) {
+    VteTerminal* terminal = replay->terminal;
+    replay->source = 0;
+
+    if (! replay->clock && gtk_widget_get_realized(GTK_WIDGET(terminal))) {
+        replay->clock = gtk_widget_get_frame_clock(GTK_WIDGET(terminal));
+        replay->paint_start_handler = g_signal_connect(replay->clock, "paint", G_CALLBACK(replay_paint), replay);
+        replay->paint_handler = g_signal_connect(replay->clock, "after-paint", G_CALLBACK(replay_frame), replay);
+    }
+
+    double now = (g_get_monotonic_time() - replay->start_time) / (double)G_USEC_PER_SEC;
+    gsize fed = 0;
+    while (replay->next < replay->events->len) {
+        ReplayEvent* event = &g_array_index(replay->events, ReplayEvent, replay->next);
+        if (replay->speed ? event->time / replay->speed > now : fed >= REPLAY_BATCH_SIZE) {
+            break;
+        }
+        vte_terminal_feed(terminal, event->data, event->length);
+        fed += event->length;
+        replay->next ++;
+    }
+    replay->bytes += fed;
+
+    if (replay->next >= replay->events->len) {
+        replay_report(replay);
+        g_object_set_data(G_OBJECT(terminal), "replay", NULL);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (replay->speed) {
+        ReplayEvent* event = &g_array_index(replay->events, ReplayEvent, replay->next);
+        guint delay = MAX(0, (event->time / replay->speed - now) * 1000);
+        replay->source = g_timeout_add(delay, (GSourceFunc)replay_step, replay);
+    } else {
+        // let it draw in between
+        replay->source = g_idle_add((GSourceFunc)replay_step, replay);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+GArray* replay_load(const char* filename) {
+    char* contents;
+    GError* error = NULL;
+    if (! g_file_get_contents(filename, &contents, NULL, &error)) {
+        g_warning("Failed to read %s: %s", filename, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    GArray* events = g_array_new(FALSE, FALSE, sizeof(ReplayEvent));
+    GString* type = g_string_new(NULL);
+    GString* data = g_string_new(NULL);
+    char** lines = g_strsplit(contents, "\n", -1);
+    free(contents);
+
+    // first line is the header
+    for (int i = 1; lines[0] && lines[i]; i ++) {
+        // [time, "o", "data"]
+        const char* p = lines[i];
+        while (g_ascii_isspace(*p)) p++;
+        if (*p++ != '[') continue;
+
+        char* end;
+        double time = g_ascii_strtod(p, &end);
+        if (end == p) continue;
+        p = end;
+        while (g_ascii_isspace(*p)) p++;
+        if (*p++ != ',') continue;
+
+        g_string_truncate(type, 0);
+        if (! (p = json_parse_string(p, type))) continue;
+        // only output events
+        if (! STR_EQUAL(type->str, "o")) continue;
+        while (g_ascii_isspace(*p)) p++;
+        if (*p++ != ',') continue;
+
+        g_string_truncate(data, 0);
+        if (! json_parse_string(p, data)) continue;
+
+        ReplayEvent event = {time, g_strndup(data->str, data->len), data->len};
+        g_array_append_val(events, event);
+    }
+
+    g_strfreev(lines);
+    g_string_free(type, TRUE);
+    g_string_free(data, TRUE);
+    return events;
+}
+
+void replay_terminal_destroyed(VteTerminal* terminal) {
+    g_object_set_data(G_OBJECT(terminal), "replay", NULL);
+}
+
+gboolean replay_start(VteTerminal* terminal, const char* filename, double speed) {
+    /*
+     * feed a recording into the terminal
+     * speed is a multiplier on the recorded pace, 0 to go as fast as possible
+     */
+    GArray* events = replay_load(filename);
+    if (! events) return FALSE;
+
+    Replay* replay = calloc(1, sizeof(Replay));
+    replay->terminal = terminal;
+    replay->events = events;
+    replay->speed = MAX(speed, 0);
+    replay->stalls = g_array_new(FALSE, FALSE, sizeof(gint64));
+    replay->paints = g_array_new(FALSE, FALSE, sizeof(gint64));
+    replay->start_time = replay->last_probe = g_get_monotonic_time();
+    replay->probe = g_timeout_add_full(G_PRIORITY_HIGH, REPLAY_PROBE_INTERVAL, (GSourceFunc)replay_probe, replay, NULL);
+    replay->source = g_idle_add((GSourceFunc)replay_step, replay);
+
+    if (! g_object_get_data(G_OBJECT(terminal), "replay")) {
+        g_signal_connect(terminal, "destroy", G_CALLBACK(replay_terminal_destroyed), NULL);
+    }
+    g_object_set_data_full(G_OBJECT(terminal), "replay", replay, (GDestroyNotify)replay_free);
+    return TRUE;
+}
@@ -0,0 +1,16 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <vte/vte.h>
+
+// most bytes fed per main loop iteration when replaying as fast as possible
+#define REPLAY_BATCH_SIZE (64*1024)
+// how often to check for main loop stalls while replaying, in ms
+#define REPLAY_PROBE_INTERVAL 5
+
+gboolean record_start(VteTerminal* terminal, const char* filename);
+void record_stop(VteTerminal* terminal);
+void recording_contents_changed(VteTerminal* terminal);
+gboolean replay_start(VteTerminal* terminal, const char* filename, double speed);
+
+#endif
@@ -0,0 +1,150 @@
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#include "regex_cache.h"
+#include "utils.h"
+
+/*
+ * process wide LRU of compiled search regexes
+ * shared across all terminals
+ * keyed on (pattern, flags, regex mode) so non-regex patterns are only escaped on a miss
+ */
+
+typedef struct {
+    char* pattern;
+    guint32 flags;
+    gboolean use_regex;
+    VteRegex* regex;
+    // equivalent for our own scans, compiled on demand
+    GRegex* gregex;
+} CachedRegex;
+
+GHashTable* regex_cache = NULL;
+// most recently used at the head
+GQueue regex_cache_order = G_QUEUE_INIT;
+guint regex_cache_hits = 0;
+guint regex_cache_misses = 0;
+guint regex_cache_evictions = 0;
+
+guint cached_regex_hash(const CachedRegex* entry) {
+    return g_str_hash(entry->pattern) ^ (entry->flags * 31) ^ entry->use_regex;
+}
+
+gboolean cached_regex_equal(const CachedRegex* a, const CachedRegex* b) {
+    return a->flags == b->flags && a->use_regex == b->use_regex && STR_EQUAL(a->pattern, b->pattern);
+}
+
+void cached_regex_free(CachedRegex* entry) {
+    vte_regex_unref(entry->regex);
+    if (entry->gregex) g_regex_unref(entry->gregex);
+    free(entry->pattern);
+    free(entry);
+}
+
+VteRegex* compile_search_regex(const char* pattern, guint32 flags, gboolean use_regex) {
+    char* escaped = use_regex ? NULL : g_regex_escape_string(pattern, -1);
+    GError* error = NULL;
+    VteRegex* regex = vte_regex_new_for_search(escaped ? escaped : pattern, -1, flags, &error);
+
+    if (error) {
+        g_warning("%s: %s", error->message, pattern);
+        g_error_free(error);
+        g_free(escaped);
+        return NULL;
+    }
+    g_free(escaped);
+
+    // not fatal if jit is unavailable
+    if (! vte_regex_jit(regex, PCRE2_JIT_COMPLETE, &error)) {
+        g_error_free(error);
+    }
+    return regex;
+}
+
+CachedRegex* regex_cache_get(const char* pattern, guint32 flags, gboolean use_regex) {
+    if (! regex_cache) {
+        regex_cache = g_hash_table_new((GHashFunc)cached_regex_hash, (GEqualFunc)cached_regex_equal);
+    }
+
+    CachedRegex key = {(char*)pattern, flags, use_regex, NULL, NULL};
+    GList* link = g_hash_table_lookup(regex_cache, &key);
+
+    if (link) {
+        regex_cache_hits ++;
+        g_queue_unlink(&regex_cache_order, link);
+        g_queue_push_head_link(&regex_cache_order, link);
+        return link->data;
+    }
+
+    regex_cache_misses ++;
+    VteRegex* regex = compile_search_regex(pattern, flags, use_regex);
+    if (! regex) return NULL;
+
+    CachedRegex* entry = malloc(sizeof(CachedRegex));
+    *entry = key;
+    entry->pattern = strdup(pattern);
+    entry->regex = regex;
+    g_queue_push_head(&regex_cache_order, entry);
+    g_hash_table_insert(regex_cache, entry, regex_cache_order.head);
+
+    while (regex_cache_order.length > REGEX_CACHE_SIZE) {
+        CachedRegex* oldest = g_queue_pop_tail(&regex_cache_order);
+        g_hash_table_remove(regex_cache, oldest);
+        cached_regex_free(oldest);
+        regex_cache_evictions ++;
+    }
+
+    return entry;
+}
+
+VteRegex* regex_cache_lookup(const char* pattern, guint32 flags, gboolean use_regex) {
+    /*
+     * returns a borrowed regex
+     * ref it if you are keeping it
+     */
+    CachedRegex* entry = regex_cache_get(pattern, flags, use_regex);
+    return entry ? entry->regex : NULL;
+}
+
+GRegex* regex_cache_lookup_gregex(const char* pattern, guint32 flags, gboolean use_regex) {
+    /*
+     * same as regex_cache_lookup() but as a GRegex
+     * which (unlike VteRegex) we can match against text ourselves, from any thread
+     */
+    CachedRegex* entry = regex_cache_get(pattern, flags, use_regex);
+    if (! entry) return NULL;
+
+    if (! entry->gregex) {
+        GRegexCompileFlags compile_flags = G_REGEX_OPTIMIZE;
+        if (flags & PCRE2_CASELESS) compile_flags |= G_REGEX_CASELESS;
+        if (flags & PCRE2_MULTILINE) compile_flags |= G_REGEX_MULTILINE;
+
+        char* escaped = use_regex ? NULL : g_regex_escape_string(pattern, -1);
+        GError* error = NULL;
+        entry->gregex = g_regex_new(escaped ? escaped : pattern, compile_flags, 0, &error);
+        g_free(escaped);
+        if (error) {
+            g_warning("%s: %s", error->message, pattern);
+            g_error_free(error);
+        }
+    }
+    return entry->gregex;
+}
+
+guint regex_cache_clear() {
+    // returns how many were dropped, borrowed regexes must not be held across this
+    guint count = regex_cache_order.length;
+    CachedRegex* entry;
+    while ((entry = g_queue_pop_tail(&regex_cache_order))) {
+        g_hash_table_remove(regex_cache, entry);
+        cached_regex_free(entry);
+    }
+    return count;
+}
+
+void regex_cache_stats(GString* output) {
+    g_string_append_printf(output, "regex-cache.size=%u\n", regex_cache_order.length);
+    g_string_append_printf(output, "regex-cache.capacity=%u\n", REGEX_CACHE_SIZE);
+    g_string_append_printf(output, "regex-cache.hits=%u\n", regex_cache_hits);
+    g_string_append_printf(output, "regex-cache.misses=%u\n", regex_cache_misses);
+    g_string_append_printf(output, "regex-cache.evictions=%u\n", regex_cache_evictions);
+}
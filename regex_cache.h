@@ -0,0 +1,13 @@
+#ifndef REGEX_CACHE_H
+#define REGEX_CACHE_H
+
+#include <vte/vte.h>
+
+#define REGEX_CACHE_SIZE 32
+
+VteRegex* regex_cache_lookup(const char* pattern, guint32 flags, gboolean use_regex);
+GRegex* regex_cache_lookup_gregex(const char* pattern, guint32 flags, gboolean use_regex);
+guint regex_cache_clear();
+void regex_cache_stats(GString* output);
+
+#endif
@@ -0,0 +1,156 @@
+#include <gtk/gtk.h>
+#include "scheduler.h"
+#include "output_match.h"
+#include "scrollback_log.h"
+#include "config.h"
+
+/*
+ * output handlers (on-output-match-*, the scrollback log) for terminals that are
+ * not visible in the focused window are deferred and coalesced into a low priority
+ * time slice once a frame, limited to background-output-budget ms
+ * all of them work off watermarks, so running once for many changes loses nothing
+ *
+ * vte itself does not let us change the priority of its pty reads or redraws,
+ * but hidden tabs are unmapped so they are not redrawn anyway
+ */
+
+typedef void(*ScheduledHandler)(VteTerminal*);
+
+ScheduledHandler scheduled_handlers[] = {
+    output_match_contents_changed,
+    scrollback_log_contents_changed,
+};
+
+GQueue scheduler_pending = G_QUEUE_INIT;
+guint scheduler_timer = 0;
+
+// counters
+guint64 scheduler_immediate = 0;
+guint64 scheduler_deferred = 0;
+guint64 scheduler_coalesced = 0;
+guint64 scheduler_forced = 0;
+guint64 scheduler_slices = 0;
+guint64 scheduler_slices_over_budget = 0;
+gint64 scheduler_slice_max = 0;
+guint64 scheduler_foreground_inserts = 0;
+guint64 scheduler_background_inserts = 0;
+
+gboolean term_is_foreground(VteTerminal* terminal) {
+    // hidden tabs are unmapped
+    if (! gtk_widget_get_mapped(GTK_WIDGET(terminal))) return FALSE;
+    GtkWidget* window = gtk_widget_get_toplevel(GTK_WIDGET(terminal));
+    return GTK_IS_WINDOW(window) && gtk_window_is_active(GTK_WINDOW(window));
+}
+
+void scheduler_run(VteTerminal* terminal) {
+    for (int i = 0; i < G_N_ELEMENTS(scheduled_handlers); i ++) {
+        scheduled_handlers[i](terminal);
+    }
+}
+
+void scheduler_forget(VteTerminal* terminal) {
+    if (g_object_get_data(G_OBJECT(terminal), "scheduler-pending")) {
+        g_queue_remove(&scheduler_pending, terminal);
+        g_object_set_data(G_OBJECT(terminal), "scheduler-pending", NULL);
+    }
+}
+
+void scheduler_flush(VteTerminal* terminal) {
+    if (g_object_get_data(G_OBJECT(terminal), "scheduler-pending")) {
+        scheduler_forget(terminal);
+        scheduler_run(terminal);
+    }
+}
+
+gboolean scheduler_slice(gpointer data) {
+    gint64 start = g_get_monotonic_time();
+    gint64 deadline = start + background_output_budget * 1000;
+    scheduler_slices ++;
+
+    VteTerminal* terminal;
+    while ((terminal = g_queue_pop_head(&scheduler_pending))) {
+        g_object_set_data(G_OBJECT(terminal), "scheduler-pending", NULL);
+        scheduler_run(terminal);
+        if (g_get_monotonic_time() >= deadline) break;
+    }
+
+    scheduler_slice_max = MAX(scheduler_slice_max, g_get_monotonic_time() - start);
+    if (g_queue_is_empty(&scheduler_pending)) {
+        scheduler_timer = 0;
+        return G_SOURCE_REMOVE;
+    }
+    // rest waits for the next frame
+    scheduler_slices_over_budget ++;
+    return G_SOURCE_CONTINUE;
+}
+
+glong scheduler_max_deferred_rows(VteTerminal* terminal) {
+    /*
+     * vte keeps at most scrollback-lines rows including the screen
+     * anything deferred past that would be gone before the handlers read it
+     * this follows the live limit, so also scrollback-memory-budget trimming
+     */
+    int scrollback;
+    g_object_get(G_OBJECT(terminal), "scrollback-lines", &scrollback, NULL);
+    if (scrollback < 0) return SCHEDULER_MAX_DEFERRED_ROWS;
+    glong room = scrollback - vte_terminal_get_row_count(terminal);
+    // leave a margin as one change can add many rows at once
+    return MIN(SCHEDULER_MAX_DEFERRED_ROWS, room / 2);
+}
+
+void scheduler_contents_changed(VteTerminal* terminal) {
+    glong max_rows = scheduler_max_deferred_rows(terminal);
+    if (background_output_budget <= 0 || max_rows <= 0 || term_is_foreground(terminal)) {
+        scheduler_forget(terminal);
+        scheduler_immediate ++;
+        scheduler_run(terminal);
+        return;
+    }
+
+    glong cursor_row;
+    vte_terminal_get_cursor_position(terminal, NULL, &cursor_row);
+
+    if (g_object_get_data(G_OBJECT(terminal), "scheduler-pending")) {
+        glong row = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(terminal), "scheduler-row"));
+        if (cursor_row - row < max_rows) {
+            scheduler_coalesced ++;
+            return;
+        }
+        // too far behind, catch up now
+        scheduler_forced ++;
+        scheduler_forget(terminal);
+        scheduler_run(terminal);
+        return;
+    }
+
+    scheduler_deferred ++;
+    g_object_set_data(G_OBJECT(terminal), "scheduler-pending", GINT_TO_POINTER(TRUE));
+    g_object_set_data(G_OBJECT(terminal), "scheduler-row", GINT_TO_POINTER(cursor_row));
+    g_queue_push_tail(&scheduler_pending, terminal);
+
+    if (! scheduler_timer) {
+        scheduler_timer = g_timeout_add_full(G_PRIORITY_LOW, SCHEDULER_FRAME_INTERVAL, scheduler_slice, NULL, NULL);
+    }
+}
+
+void scheduler_count_text_inserted(VteTerminal* terminal) {
+    if (gtk_widget_has_focus(GTK_WIDGET(terminal))) {
+        scheduler_foreground_inserts ++;
+    } else {
+        scheduler_background_inserts ++;
+    }
+}
+
+void scheduler_stats(GString* output) {
+    g_string_append_printf(output, "scheduler.budget-ms=%i\n", background_output_budget);
+    g_string_append_printf(output, "scheduler.immediate=%" G_GUINT64_FORMAT "\n", scheduler_immediate);
+    g_string_append_printf(output, "scheduler.deferred=%" G_GUINT64_FORMAT "\n", scheduler_deferred);
+    g_string_append_printf(output, "scheduler.coalesced=%" G_GUINT64_FORMAT "\n", scheduler_coalesced);
+    g_string_append_printf(output, "scheduler.forced=%" G_GUINT64_FORMAT "\n", scheduler_forced);
+    g_string_append_printf(output, "scheduler.pending=%u\n", g_queue_get_length(&scheduler_pending));
+    g_string_append_printf(output, "scheduler.slices=%" G_GUINT64_FORMAT "\n", scheduler_slices);
+    g_string_append_printf(output, "scheduler.slices-over-budget=%" G_GUINT64_FORMAT "\n", scheduler_slices_over_budget);
+    g_string_append_printf(output, "scheduler.slice-max-us=%" G_GINT64_FORMAT "\n", scheduler_slice_max);
+    g_string_append_printf(output, "scheduler.text-inserted.focused=%" G_GUINT64_FORMAT "\n", scheduler_foreground_inserts);
+    g_string_append_printf(output, "scheduler.text-inserted.background=%" G_GUINT64_FORMAT "\n", scheduler_background_inserts);
+}
@@ -0,0 +1,19 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <vte/vte.h>
+
+// deferred output is processed at most once per frame
+#define SCHEDULER_FRAME_INTERVAL 16
+// run deferred output straight away once this many rows have built up
+// or half the room left in the scrollback, whichever is less
+// so nothing scrolls out of the scrollback before it is seen
+#define SCHEDULER_MAX_DEFERRED_ROWS 1000
+
+void scheduler_contents_changed(VteTerminal* terminal);
+void scheduler_flush(VteTerminal* terminal);
+void scheduler_forget(VteTerminal* terminal);
+void scheduler_count_text_inserted(VteTerminal* terminal);
+void scheduler_stats(GString* output);
+
+#endif
@@ -0,0 +1,371 @@
+#define _GNU_SOURCE
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <zlib.h>
+#include "scrollback_log.h"
+#include "terminal.h"
+#include "regex_cache.h"
+#include "config.h"
+#include "utils.h"
+
+/*
+ * optional on-disk log of everything that scrolls through a terminal
+ * so history is not limited by (and does not cost) scrollback-lines
+ *
+ * committed rows are buffered on the main thread
+ * and handed off in blocks to a writer thread (one shared by every terminal) which zlib compresses and appends them to the file
+ * a sparse index (one entry per block) is kept in memory so a range of lines only needs the blocks covering it
+ * blocks not yet written are kept around so reads never wait on the writer
+ * the log is deleted when the terminal goes away
+ */
+
+typedef struct {
+    gint64 first_line;
+    guint32 lines;
+    guint32 length;
+    // 0 if the block could not be written
+    guint32 compressed;
+    goffset offset;
+} LogBlock;
+
+typedef struct scrollback_log ScrollbackLog;
+
+typedef struct {
+    ScrollbackLog* log;
+    gint64 first_line;
+    guint32 lines;
+    // NULL to close the log
+    GBytes* data;
+} LogWrite;
+
+struct scrollback_log {
+    int fd;
+    char* path;
+
+    // shared with the writer thread
+    GMutex lock;
+    GArray* index;
+    // LogWrite handed off but not yet in the index, oldest first
+    GQueue* unwritten;
+
+    // writer thread only
+    goffset offset;
+
+    // main thread only
+    GString* pending;
+    gint64 pending_first_line;
+    guint pending_lines;
+};
+
+// blocks from every log are written in order by a single thread
+GThreadPool* scrollback_log_pool = NULL;
+
+void scrollback_log_close(ScrollbackLog* log) {
+    close(log->fd);
+    g_unlink(log->path);
+    free(log->path);
+    g_mutex_clear(&log->lock);
+    g_array_free(log->index, TRUE);
+    g_queue_free(log->unwritten);
+    g_string_free(log->pending, TRUE);
+    free(log);
+}
+
+gboolean scrollback_log_pwrite(int fd, const char* data, gsize size, goffset offset) {
+    // write at offset, so a failed (partial) write does not shift where later blocks go
+    while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            g_warning("Failed to write scrollback log: %s", written < 0 ? strerror(errno) : "no space");
+            return FALSE;
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+    return TRUE;
+}
+
+void scrollback_log_writer(LogWrite* item, gpointer data) {
+    ScrollbackLog* log = item->log;
+    if (! item->data) {
+        // everything before this has been written
+        scrollback_log_close(log);
+        free(item);
+        return;
+    }
+
+    gsize length;
+    const Bytef* text = g_bytes_get_data(item->data, &length);
+    uLongf size = compressBound(length);
+    Bytef* buffer = malloc(size);
+    LogBlock block = {item->first_line, item->lines, length, 0, log->offset};
+
+    if (compress2(buffer, &size, text, length, Z_BEST_SPEED) != Z_OK) {
+        g_warning("Failed to compress scrollback log block");
+    } else if (scrollback_log_pwrite(log->fd, (char*)buffer, size, log->offset)) {
+        block.compressed = size;
+        log->offset += size;
+    }
+    free(buffer);
+
+    g_mutex_lock(&log->lock);
+    g_array_append_val(log->index, block);
+    g_queue_pop_head(log->unwritten);
+    g_mutex_unlock(&log->lock);
+
+    g_bytes_unref(item->data);
+    free(item);
+}
+
+void scrollback_log_queue(ScrollbackLog* log, LogWrite* item) {
+    if (! scrollback_log_pool) {
+        scrollback_log_pool = g_thread_pool_new((GFunc)scrollback_log_writer, NULL, 1, FALSE, NULL);
+    }
+    g_thread_pool_push(scrollback_log_pool, item, NULL);
+}
+
+void scrollback_log_free(ScrollbackLog* log) {
+    // the writer closes it once it is done with what is queued, so this never waits
+    LogWrite* item = calloc(1, sizeof(LogWrite));
+    item->log = log;
+    scrollback_log_queue(log, item);
+}
+
+void scrollback_log_shutdown() {
+    // on exit, let the writer finish anything still queued
+    if (scrollback_log_pool) {
+        g_thread_pool_free(scrollback_log_pool, FALSE, TRUE);
+        scrollback_log_pool = NULL;
+    }
+}
+
+ScrollbackLog* scrollback_log_get(VteTerminal* terminal, gboolean create) {
+    ScrollbackLog* log = g_object_get_data(G_OBJECT(terminal), "scrollback-log");
+    if (log || ! create || ! scrollback_log_dir) return log;
+    // don't keep retrying
+    if (g_object_get_data(G_OBJECT(terminal), "scrollback-log-failed")) return NULL;
+
+    char* path = g_strdup_printf("%s/%s-%i-%u.log", scrollback_log_dir, APP_PREFIX_LOWER, getpid(), term_get_id(terminal));
+    int fd = -1;
+    if (g_mkdir_with_parents(scrollback_log_dir, 0700) == 0) {
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    }
+    if (fd < 0) {
+        g_warning("Failed to open scrollback log %s: %s", path, strerror(errno));
+        g_object_set_data(G_OBJECT(terminal), "scrollback-log-failed", GINT_TO_POINTER(1));
+        free(path);
+        return NULL;
+    }
+
+    log = calloc(1, sizeof(ScrollbackLog));
+    log->fd = fd;
+    log->path = path;
+    g_mutex_init(&log->lock);
+    log->index = g_array_new(FALSE, FALSE, sizeof(LogBlock));
+    log->unwritten = g_queue_new();
+    log->pending = g_string_new(NULL);
+    g_object_set_data_full(G_OBJECT(terminal), "scrollback-log", log, (GDestroyNotify)scrollback_log_free);
+    return log;
+}
+
+void scrollback_log_flush(ScrollbackLog* log) {
+    // hand off all complete lines to the writer thread
+    char* last = memrchr(log->pending->str, '\n', log->pending->len);
+    if (! last) return;
+    gsize length = last - log->pending->str + 1;
+
+    LogWrite* item = malloc(sizeof(LogWrite));
+    item->log = log;
+    item->first_line = log->pending_first_line;
+    item->lines = log->pending_lines;
+    item->data = g_bytes_new(log->pending->str, length);
+
+    g_mutex_lock(&log->lock);
+    g_queue_push_tail(log->unwritten, item);
+    g_mutex_unlock(&log->lock);
+    scrollback_log_queue(log, item);
+
+    log->pending_first_line += log->pending_lines;
+    log->pending_lines = 0;
+    g_string_erase(log->pending, 0, length);
+}
+
+void scrollback_log_contents_changed(VteTerminal* terminal) {
+    glong start, end;
+    if (! term_get_committed_rows(terminal, "scrollback-log-watermark", &start, &end)) return;
+
+    ScrollbackLog* log = scrollback_log_get(terminal, TRUE);
+    if (! log) return;
+
+    char* text = vte_terminal_get_text_range(terminal, start, 0, end, -1, NULL, NULL, NULL);
+    if (! text) return;
+    for (char* p = text; (p = strchr(p, '\n')); p ++) {
+        log->pending_lines ++;
+    }
+    g_string_append(log->pending, text);
+    free(text);
+
+    if (log->pending->len >= SCROLLBACK_LOG_BLOCK_SIZE) {
+        scrollback_log_flush(log);
+    }
+}
+
+gint64 scrollback_log_line_count(VteTerminal* terminal) {
+    ScrollbackLog* log = scrollback_log_get(terminal, FALSE);
+    return log ? log->pending_first_line + log->pending_lines : 0;
+}
+
+GArray* scrollback_log_snapshot(ScrollbackLog* log, GArray* unwritten) {
+    /*
+     * copy the index, and the blocks the writer has not got to yet (with a ref on their text)
+     * so reading never waits on it
+     */
+    g_mutex_lock(&log->lock);
+    GArray* index = g_array_sized_new(FALSE, FALSE, sizeof(LogBlock), log->index->len);
+    g_array_append_vals(index, log->index->data, log->index->len);
+    for (GList* node = log->unwritten->head; node; node = node->next) {
+        LogWrite item = *(LogWrite*)node->data;
+        g_bytes_ref(item.data);
+        g_array_append_val(unwritten, item);
+    }
+    g_mutex_unlock(&log->lock);
+    return index;
+}
+
+char* scrollback_log_read_block(ScrollbackLog* log, LogBlock* block) {
+    if (! block->compressed) return NULL;
+
+    Bytef* buffer = malloc(block->compressed);
+    char* data = NULL;
+    if (pread(log->fd, buffer, block->compressed, block->offset) == block->compressed) {
+        uLongf length = block->length;
+        data = malloc(length + 1);
+        if (uncompress((Bytef*)data, &length, buffer, block->compressed) == Z_OK) {
+            data[length] = '\0';
+        } else {
+            g_warning("Corrupt block in scrollback log %s", log->path);
+            free(data);
+            data = NULL;
+        }
+    }
+    free(buffer);
+    return data;
+}
+
+typedef gboolean(*LogLineFunc)(gint64 line, const char* text, gsize length, gpointer data);
+
+gboolean scrollback_log_foreach_text(gint64 line, const char* text, gsize length, gint64 start, gint64 end, LogLineFunc func, gpointer data) {
+    // returns FALSE once func asks to stop or end is reached
+    const char* stop = text + length;
+    for (const char* next; text < stop; text = next, line ++) {
+        if (line >= end) return FALSE;
+        next = memchr(text, '\n', stop - text);
+        if (! next) next = stop;
+        if (line >= start && ! func(line, text, next - text, data)) return FALSE;
+        if (next < stop) next ++;
+    }
+    return TRUE;
+}
+
+void scrollback_log_foreach_line(ScrollbackLog* log, gint64 start, gint64 end, LogLineFunc func, gpointer data) {
+    /*
+     * calls func on each line in [start, end)
+     * only the blocks covering the range are read + decompressed
+     */
+    GArray* unwritten = g_array_new(FALSE, FALSE, sizeof(LogWrite));
+    GArray* index = scrollback_log_snapshot(log, unwritten);
+
+    // binary search for the first block
+    int lo = 0, hi = index->len;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        LogBlock* block = &g_array_index(index, LogBlock, mid);
+        if (block->first_line + block->lines <= start) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    gboolean more = TRUE;
+    for (int i = lo; more && i < index->len; i ++) {
+        LogBlock* block = &g_array_index(index, LogBlock, i);
+        char* text = scrollback_log_read_block(log, block);
+        if (text) {
+            more = scrollback_log_foreach_text(block->first_line, text, block->length, start, end, func, data);
+            free(text);
+        }
+    }
+
+    for (guint i = 0; i < unwritten->len; i ++) {
+        LogWrite* item = &g_array_index(unwritten, LogWrite, i);
+        if (more && item->first_line + item->lines > start) {
+            gsize length;
+            const char* text = g_bytes_get_data(item->data, &length);
+            more = scrollback_log_foreach_text(item->first_line, text, length, start, end, func, data);
+        }
+        g_bytes_unref(item->data);
+    }
+
+    // not handed off yet
+    if (more) {
+        scrollback_log_foreach_text(log->pending_first_line, log->pending->str, log->pending->len, start, end, func, data);
+    }
+
+    g_array_free(unwritten, TRUE);
+    g_array_free(index, TRUE);
+}
+
+typedef struct {
+    GRegex* regex;
+    GString* output;
+    int count;
+} LogSearch;
+
+gboolean scrollback_log_search_line(gint64 line, const char* text, gsize length, LogSearch* search) {
+    if (g_regex_match_full(search->regex, text, length, 0, 0, NULL, NULL)) {
+        g_string_append_printf(search->output, "%" G_GINT64_FORMAT "\t", line);
+        g_string_append_len(search->output, text, length);
+        g_string_append_c(search->output, '\n');
+        search->count ++;
+    }
+    return TRUE;
+}
+
+char* scrollback_log_search(VteTerminal* terminal, const char* pattern, int* count) {
+    // returns line<TAB>text for each matching line
+    if (count) *count = 0;
+    ScrollbackLog* log = scrollback_log_get(terminal, FALSE);
+    if (! log || ! pattern || ! *pattern) return NULL;
+
+    GRegex* regex = regex_cache_lookup_gregex(pattern, search_pattern_flags(pattern), search_use_regex);
+    if (! regex) return NULL;
+
+    LogSearch search = {g_regex_ref(regex), g_string_new(NULL), 0};
+    scrollback_log_foreach_line(log, 0, G_MAXINT64, (LogLineFunc)scrollback_log_search_line, &search);
+    g_regex_unref(search.regex);
+    if (count) *count = search.count;
+    return g_string_free(search.output, FALSE);
+}
+
+gboolean scrollback_log_export_line(gint64 line, const char* text, gsize length, GString* output) {
+    g_string_append_len(output, text, length);
+    g_string_append_c(output, '\n');
+    return TRUE;
+}
+
+char* scrollback_log_export(VteTerminal* terminal, gint64 start, gint64 end) {
+    // lines [start, end)
+    ScrollbackLog* log = scrollback_log_get(terminal, FALSE);
+    if (! log) return NULL;
+
+    GString* output = g_string_new(NULL);
+    scrollback_log_foreach_line(log, start, end, (LogLineFunc)scrollback_log_export_line, output);
+    return g_string_free(output, FALSE);
+}
@@ -0,0 +1,15 @@
+#ifndef SCROLLBACK_LOG_H
+#define SCROLLBACK_LOG_H
+
+#include <vte/vte.h>
+
+// uncompressed size at which buffered lines are handed to the writer thread
+#define SCROLLBACK_LOG_BLOCK_SIZE (64*1024)
+
+void scrollback_log_shutdown();
+void scrollback_log_contents_changed(VteTerminal* terminal);
+gint64 scrollback_log_line_count(VteTerminal* terminal);
+char* scrollback_log_search(VteTerminal* terminal, const char* pattern, int* count);
+char* scrollback_log_export(VteTerminal* terminal, gint64 start, gint64 end);
+
+#endif
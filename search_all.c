@@ -0,0 +1,227 @@
+#include <gtk/gtk.h>
+#include <string.h>
+#include "search_all.h"
+#include "search_scan.h"
+#include "terminal.h"
+#include "window.h"
+#include "split.h"
+#include "regex_cache.h"
+#include "config.h"
+#include "utils.h"
+
+/*
+ * search the scrollback of every terminal at once
+ * text is snapshotted a chunk at a time from idle callbacks on the main thread
+ * and matched on a thread pool, finished chunks come back through an async queue
+ * the ui keeps running throughout and the callback gets the result at the end
+ */
+
+typedef struct {
+    VteTerminal* terminal;
+    int window;
+    int tab;
+} SearchAllTarget;
+
+typedef struct {
+    guint index;
+    SearchAllTarget* target;
+    glong lower;
+    glong end_row;
+    char* text;
+    GArray* attrs;
+    GArray* matches;
+} SearchAllChunk;
+
+typedef struct {
+    GRegex* regex;
+    gboolean focus;
+    SearchAllCallback callback;
+    gpointer data;
+
+    GThreadPool* pool;
+    // chunks the workers have finished with
+    GAsyncQueue* queue;
+    GPtrArray* done;
+    int in_flight;
+    int limit;
+
+    GArray* targets;
+    guint target;
+    glong next_row;
+    guint index;
+} SearchAllJob;
+
+void search_all_chunk_free(SearchAllChunk* chunk) {
+    g_array_free(chunk->matches, TRUE);
+    free(chunk);
+}
+
+void search_all_worker(SearchAllChunk* chunk, SearchAllJob* job) {
+    search_scan_text(job->regex, chunk->text, chunk->attrs, NULL, chunk->matches);
+    free(chunk->text);
+    g_array_free(chunk->attrs, TRUE);
+    g_async_queue_push(job->queue, chunk);
+}
+
+gint search_all_chunk_compare(SearchAllChunk** a, SearchAllChunk** b) {
+    return (*a)->index < (*b)->index ? -1 : (*a)->index > (*b)->index;
+}
+
+void search_all_focus_match(SearchAllChunk* chunk, SearchMatch* match) {
+    VteTerminal* terminal = chunk->target->terminal;
+    GtkWidget* tab = term_get_tab(terminal);
+    GtkNotebook* notebook = GTK_NOTEBOOK(gtk_widget_get_parent(tab));
+    gtk_notebook_set_current_page(notebook, gtk_notebook_page_num(notebook, tab));
+    gtk_window_present(GTK_WINDOW(term_get_window(terminal)));
+    term_set_focus(terminal, TRUE);
+    term_select_range(terminal, match->col, match->row - chunk->lower, match->end_col, match->end_row - chunk->lower, 0, FALSE);
+}
+
+void search_all_finish(SearchAllJob* job) {
+    /*
+     * one line per match:
+     * window<TAB>tab<TAB>terminal id<TAB>row<TAB>col
+     * rows are counted from the top of the scrollback, like select_range and pipe_rows
+     */
+    g_ptr_array_sort(job->done, (GCompareFunc)search_all_chunk_compare);
+
+    GString* output = g_string_new(NULL);
+    int count = 0;
+    gboolean focused = ! job->focus;
+    for (guint i = 0; i < job->done->len; i ++) {
+        SearchAllChunk* chunk = job->done->pdata[i];
+        VteTerminal* terminal = chunk->target->terminal;
+        // closed while searching
+        if (gtk_widget_in_destruction(GTK_WIDGET(terminal))) continue;
+
+        for (guint j = 0; j < chunk->matches->len; j ++) {
+            SearchMatch* match = &g_array_index(chunk->matches, SearchMatch, j);
+            // matches starting on the overlapping row belong to the next chunk
+            if (match->row >= chunk->end_row) continue;
+
+            g_string_append_printf(output, "%i\t%i\t%u\t%li\t%li\n", chunk->target->window, chunk->target->tab, term_get_id(terminal), match->row - chunk->lower, match->col);
+            count ++;
+            if (! focused) {
+                search_all_focus_match(chunk, match);
+                focused = TRUE;
+            }
+        }
+    }
+
+    job->callback(g_string_free(output, FALSE), count, job->data);
+
+    // nothing is in flight, so this does not wait
+    if (job->pool) g_thread_pool_free(job->pool, FALSE, TRUE);
+    g_async_queue_unref(job->queue);
+    g_ptr_array_free(job->done, TRUE);
+    for (guint i = 0; i < job->targets->len; i ++) {
+        g_object_unref(g_array_index(job->targets, SearchAllTarget*, i)->terminal);
+        free(g_array_index(job->targets, SearchAllTarget*, i));
+    }
+    g_array_free(job->targets, TRUE);
+    if (job->regex) g_regex_unref(job->regex);
+    free(job);
+}
+
+gboolean search_all_snapshot_chunk(SearchAllJob* job) {
+    // returns FALSE once everything has been snapshotted
+    while (job->target < job->targets->len) {
+        SearchAllTarget* target = g_array_index(job->targets, SearchAllTarget*, job->target);
+        int lower, upper;
+        if (! gtk_widget_in_destruction(GTK_WIDGET(target->terminal))) {
+            term_get_row_positions(target->terminal, NULL, NULL, &lower, &upper);
+            if (job->next_row < lower) job->next_row = lower;
+
+            if (job->next_row < upper) {
+                glong start = job->next_row;
+                SearchAllChunk* chunk = malloc(sizeof(SearchAllChunk));
+                chunk->index = job->index ++;
+                chunk->target = target;
+                chunk->lower = lower;
+                chunk->end_row = MIN(start + SEARCH_SCAN_CHUNK_ROWS, upper);
+                chunk->attrs = g_array_new(FALSE, FALSE, sizeof(VteCharAttributes));
+                chunk->matches = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+                // overlap by a row so matches can wrap onto the next chunk
+                chunk->text = vte_terminal_get_text_range(target->terminal, start, 0, MIN(chunk->end_row+1, upper), -1, NULL, NULL, chunk->attrs);
+                if (! chunk->text) chunk->text = strdup("");
+
+                job->next_row = chunk->end_row;
+                job->in_flight ++;
+                g_thread_pool_push(job->pool, chunk, NULL);
+                return TRUE;
+            }
+        }
+
+        // on to the next terminal
+        job->target ++;
+        job->next_row = 0;
+    }
+    return FALSE;
+}
+
+gboolean search_all_step(SearchAllJob* job) {
+    SearchAllChunk* chunk;
+    while ((chunk = g_async_queue_try_pop(job->queue))) {
+        g_ptr_array_add(job->done, chunk);
+        job->in_flight --;
+    }
+
+    // keep a bound on how much text is snapshotted but not yet matched
+    // and on how long the main loop is held up
+    gint64 deadline = g_get_monotonic_time() + SEARCH_ALL_STEP_BUDGET * 1000;
+    gboolean more = job->target < job->targets->len;
+    while (more && job->in_flight < job->limit && g_get_monotonic_time() < deadline) {
+        more = search_all_snapshot_chunk(job);
+    }
+
+    if (! more && job->in_flight == 0) {
+        search_all_finish(job);
+    } else if (more && job->in_flight < job->limit) {
+        g_idle_add((GSourceFunc)search_all_step, job);
+    } else {
+        // waiting on the workers
+        g_timeout_add(SEARCH_ALL_POLL_INTERVAL, (GSourceFunc)search_all_step, job);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void search_all_terminals(const char* pattern, gboolean focus, SearchAllCallback callback, gpointer data) {
+    /*
+     * callback always gets called later from the main loop, with an empty result on error
+     */
+    SearchAllJob* job = calloc(1, sizeof(SearchAllJob));
+    job->focus = focus;
+    job->callback = callback;
+    job->data = data;
+    job->queue = g_async_queue_new();
+    job->done = g_ptr_array_new_with_free_func((GDestroyNotify)search_all_chunk_free);
+    job->targets = g_array_new(FALSE, FALSE, sizeof(SearchAllTarget*));
+
+    GRegex* regex = pattern && *pattern ? regex_cache_lookup_gregex(pattern, search_pattern_flags(pattern), search_use_regex) : NULL;
+    if (regex) {
+        job->regex = g_regex_ref(regex);
+
+        int threads = g_get_num_processors();
+        job->limit = threads * SEARCH_ALL_CHUNKS_PER_THREAD;
+        job->pool = g_thread_pool_new((GFunc)search_all_worker, job, threads, FALSE, NULL);
+
+        // fix the numbering now, tabs may move while searching
+        int window_num = 0;
+        FOREACH_WINDOW(window) {
+            int tab_num = 0;
+            FOREACH_TAB(tab, window) {
+                FOREACH_TERMINAL(terminal, tab) {
+                    SearchAllTarget* target = malloc(sizeof(SearchAllTarget));
+                    target->terminal = g_object_ref(terminal);
+                    target->window = window_num;
+                    target->tab = tab_num;
+                    g_array_append_val(job->targets, target);
+                }
+                tab_num ++;
+            }
+            window_num ++;
+        }
+    }
+
+    g_idle_add((GSourceFunc)search_all_step, job);
+}
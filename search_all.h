@@ -0,0 +1,18 @@
+#ifndef SEARCH_ALL_H
+#define SEARCH_ALL_H
+
+#include <vte/vte.h>
+
+// chunks waiting to be matched at any one time, per worker thread
+#define SEARCH_ALL_CHUNKS_PER_THREAD 2
+// ms spent snapshotting text per idle callback
+#define SEARCH_ALL_STEP_BUDGET 4
+// ms between checks while waiting on the workers
+#define SEARCH_ALL_POLL_INTERVAL 5
+
+// output is owned by the callback
+typedef void(*SearchAllCallback)(char* output, int count, gpointer data);
+
+void search_all_terminals(const char* pattern, gboolean focus, SearchAllCallback callback, gpointer data);
+
+#endif
@@ -1,5 +1,8 @@
 #include "search_bar.h"
 #include "terminal.h"
+#include "search_scan.h"
+#include "search_count.h"
+#include "config.h"
 #include "utils.h"
 
 void search_bar_size_allocate(GtkWidget* bar, GdkRectangle* alloc, GtkWidget* grid) {
@@ -10,9 +13,39 @@ void search_bar_size_allocate(GtkWidget* bar, GdkRectangle* alloc, GtkWidget* gr
     gtk_widget_size_allocate(grid, &rect);
 }
 
+void search_bar_update_count(VteTerminal* terminal) {
+    GtkWidget* grid = term_get_grid(terminal);
+    if (! grid) return;
+    GtkWidget* bar = g_object_get_data(G_OBJECT(grid), "searchbar");
+    GtkWidget* entry = g_object_get_data(G_OBJECT(bar), "entry");
+    GtkWidget* label = g_object_get_data(G_OBJECT(entry), "count");
+
+    char buffer[64] = "";
+    SearchCount* count = search_count_get(terminal, gtk_entry_get_text(GTK_ENTRY(entry)));
+    if (count) {
+        guint len = count->matches->len;
+        int index = count->complete ? search_count_selected(count, terminal) : -1;
+        if (index >= 0) {
+            snprintf(buffer, sizeof(buffer), "%i of %u", index+1, len);
+        } else {
+            snprintf(buffer, sizeof(buffer), "%u%s %s", len, count->complete ? "" : "+", len == 1 ? "match" : "matches");
+        }
+    }
+    gtk_label_set_text(GTK_LABEL(label), buffer);
+}
+
 void search_match(GtkWidget* entry, int direction) {
     VteTerminal* terminal = g_object_get_data(G_OBJECT(entry), "terminal");
-    gboolean found = term_search(terminal, gtk_entry_get_text(GTK_ENTRY(entry)), direction);
+    const char* pattern = gtk_entry_get_text(GTK_ENTRY(entry));
+    gboolean found;
+
+    SearchCount* count = search_count_get(terminal, pattern);
+    if (direction && search_count_is_current(count, terminal) && term_search_set_pattern(terminal, pattern)) {
+        // we already know where all the matches are
+        found = search_count_select(count, terminal, direction);
+    } else {
+        found = term_search(terminal, pattern, direction);
+    }
 
     GtkWidget* bar = g_object_get_data(G_OBJECT(entry), "bar");
     if (found) {
@@ -20,6 +53,109 @@ void search_match(GtkWidget* entry, int direction) {
     } else {
         ADD_CSS_CLASS(bar, "not-found");
     }
+    search_bar_update_count(terminal);
+}
+
+void search_bar_scan_progress(SearchScan* scan, GtkWidget* entry) {
+    GtkWidget* bar = g_object_get_data(G_OBJECT(entry), "bar");
+
+    if (scan->matches->len && ! g_object_get_data(G_OBJECT(entry), "scan-selected")) {
+        // jump as soon as we know there is a match, the rest can carry on in the background
+        g_object_set_data(G_OBJECT(entry), "scan-selected", GINT_TO_POINTER(1));
+        if (term_search(scan->terminal, scan->pattern, 0)) {
+            REMOVE_CSS_CLASS(bar, "not-found");
+        } else {
+            ADD_CSS_CLASS(bar, "not-found");
+        }
+    }
+
+    if (scan->complete) {
+        if (! scan->matches->len) {
+            term_search_set_pattern(scan->terminal, scan->pattern);
+            ADD_CSS_CLASS(bar, "not-found");
+        }
+        search_count_update(scan->terminal, scan->pattern);
+        search_bar_update_count(scan->terminal);
+
+        // keep it around so the next keystroke can refine it
+        g_object_steal_data(G_OBJECT(entry), "scan");
+        g_object_set_data_full(G_OBJECT(entry), "last-scan", scan, (GDestroyNotify)search_scan_free);
+    }
+}
+
+void search_bar_start_scan(GtkWidget* entry) {
+    VteTerminal* terminal = g_object_get_data(G_OBJECT(entry), "terminal");
+    const char* text = gtk_entry_get_text(GTK_ENTRY(entry));
+    SearchScan* previous = g_object_get_data(G_OBJECT(entry), "last-scan");
+
+    g_object_set_data(G_OBJECT(entry), "scan-selected", NULL);
+    SearchScan* scan = search_scan_start(terminal, text, previous, (SearchScanCallback)search_bar_scan_progress, entry);
+    if (scan) {
+        g_object_set_data_full(G_OBJECT(entry), "scan", scan, (GDestroyNotify)search_scan_free);
+    } else {
+        // invalid pattern
+        search_match(entry, 0);
+    }
+}
+
+gboolean search_debounce_timeout(GtkWidget* entry) {
+    g_object_set_data(G_OBJECT(entry), "debounce-timer", NULL);
+    search_bar_start_scan(entry);
+    return G_SOURCE_REMOVE;
+}
+
+void search_bar_cancel(GtkWidget* entry) {
+    guint timer = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(entry), "debounce-timer"));
+    if (timer) {
+        g_source_remove(timer);
+        g_object_set_data(G_OBJECT(entry), "debounce-timer", NULL);
+    }
+    // drops any scan in progress
+    g_object_set_data(G_OBJECT(entry), "scan", NULL);
+}
+
+gboolean search_count_timeout(GtkWidget* entry) {
+    g_object_set_data(G_OBJECT(entry), "count-timer", NULL);
+    VteTerminal* terminal = g_object_get_data(G_OBJECT(entry), "terminal");
+    search_count_update(terminal, gtk_entry_get_text(GTK_ENTRY(entry)));
+    search_bar_update_count(terminal);
+    return G_SOURCE_REMOVE;
+}
+
+void search_bar_contents_changed(VteTerminal* terminal, GtkWidget* entry) {
+    // keep the count up to date with new output, but not on every single change
+    GtkWidget* bar = g_object_get_data(G_OBJECT(entry), "bar");
+    if (gtk_widget_in_destruction(entry)) return;
+    if (! gtk_search_bar_get_search_mode(GTK_SEARCH_BAR(bar))) return;
+    if (g_object_get_data(G_OBJECT(entry), "count-timer")) return;
+    if (! search_count_get(terminal, gtk_entry_get_text(GTK_ENTRY(entry)))) return;
+
+    guint timer = g_timeout_add(MAX(search_debounce_interval, 1), (GSourceFunc)search_count_timeout, entry);
+    g_object_set_data(G_OBJECT(entry), "count-timer", GUINT_TO_POINTER(timer));
+}
+
+void search_changed(GtkWidget* entry) {
+    search_bar_cancel(entry);
+    search_bar_update_count(g_object_get_data(G_OBJECT(entry), "terminal"));
+
+    if (! *gtk_entry_get_text(GTK_ENTRY(entry))) {
+        // clearing is cheap
+        search_match(entry, 0);
+    } else if (search_debounce_interval > 0) {
+        guint timer = g_timeout_add(search_debounce_interval, (GSourceFunc)search_debounce_timeout, entry);
+        g_object_set_data(G_OBJECT(entry), "debounce-timer", GUINT_TO_POINTER(timer));
+    } else {
+        search_bar_start_scan(entry);
+    }
+}
+
+void search_entry_destroy(GtkWidget* entry) {
+    search_bar_cancel(entry);
+    guint timer = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(entry), "count-timer"));
+    if (timer) {
+        g_source_remove(timer);
+    }
+    g_object_set_data(G_OBJECT(entry), "last-scan", NULL);
 }
 
 gboolean search_key_pressed(GtkWidget* entry, GdkEventKey* event) {
@@ -75,9 +211,17 @@ GtkWidget* search_bar_new(VteTerminal* terminal) {
     g_signal_connect(entry, "key-press-event", G_CALLBACK(search_key_pressed), NULL);
     g_signal_connect(entry, "next-match", G_CALLBACK(search_match), GINT_TO_POINTER(-1));
     g_signal_connect(entry, "previous-match", G_CALLBACK(search_match), GINT_TO_POINTER(1));
-    g_signal_connect(entry, "search-changed", G_CALLBACK(search_match), GINT_TO_POINTER(0));
+    // gtk has its own fixed delay on search-changed, we debounce ourselves instead
+    g_signal_connect(entry, "changed", G_CALLBACK(search_changed), NULL);
+    g_signal_connect(entry, "destroy", G_CALLBACK(search_entry_destroy), NULL);
     g_object_set_data(G_OBJECT(entry), "terminal", terminal);
     g_signal_connect_swapped(entry, "stop-search", G_CALLBACK(focus_widget), terminal);
+    g_signal_connect_object(terminal, "contents-changed", G_CALLBACK(search_bar_contents_changed), entry, 0);
+    // after the terminal has updated its own selection state
+    g_signal_connect_after(terminal, "selection-changed", G_CALLBACK(search_bar_update_count), NULL);
+
+    GtkWidget* count = gtk_label_new("");
+    g_object_set_data(G_OBJECT(entry), "count", count);
 
     GtkWidget* down = gtk_button_new_from_icon_name("go-down", GTK_ICON_SIZE_LARGE_TOOLBAR);
     GtkWidget* up = gtk_button_new_from_icon_name("go-up", GTK_ICON_SIZE_LARGE_TOOLBAR);
@@ -92,6 +236,7 @@ GtkWidget* search_bar_new(VteTerminal* terminal) {
     gtk_container_add(GTK_CONTAINER(grid), entry);
     gtk_container_add(GTK_CONTAINER(grid), up);
     gtk_container_add(GTK_CONTAINER(grid), down);
+    gtk_container_add(GTK_CONTAINER(grid), count);
 
     GtkWidget* bar = gtk_search_bar_new();
     gtk_container_add(GTK_CONTAINER(bar), grid);
@@ -5,6 +5,7 @@
 
 GtkWidget* search_bar_new(VteTerminal* terminal);
 void search_bar_show(GtkWidget* bar);
+void search_bar_update_count(VteTerminal* terminal);
 #define search_bar_hide(bar) gtk_search_bar_set_search_mode(GTK_SEARCH_BAR(bar), FALSE)
 
 #endif
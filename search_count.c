@@ -0,0 +1,289 @@
+#include <string.h>
+#include "search_count.h"
+#include "search_scan.h"
+#include "search_bar.h"
+#include "terminal.h"
+#include "regex_cache.h"
+#include "config.h"
+#include "utils.h"
+
+/*
+ * counts every match of the search pattern so we can show "N of M" and highlight them all
+ * the text is snapshotted a chunk at a time on the main thread (vte is not thread safe)
+ * and matched on a worker thread
+ * results are kept per terminal, so new output only rescans the rows that could have changed
+ */
+
+typedef struct {
+    guint serial;
+    GRegex* regex;
+    glong start_row;
+    glong end_row;
+    char* text;
+    GArray* attrs;
+    GArray* matches;
+} SearchCountChunk;
+
+void search_count_chunk_free(SearchCountChunk* chunk) {
+    g_regex_unref(chunk->regex);
+    free(chunk->text);
+    g_array_free(chunk->attrs, TRUE);
+    g_array_free(chunk->matches, TRUE);
+    free(chunk);
+}
+
+void search_count_free(SearchCount* count) {
+    g_object_unref(count->cancellable);
+    if (count->regex) g_regex_unref(count->regex);
+    g_array_free(count->matches, TRUE);
+    free(count->pattern);
+    free(count);
+}
+
+SearchCount* search_count_get(VteTerminal* terminal, const char* pattern) {
+    SearchCount* count = g_object_get_data(G_OBJECT(terminal), "search-count");
+    if (! count || ! pattern || ! count->pattern) return NULL;
+    if (! STR_EQUAL(count->pattern, pattern)) return NULL;
+    if (count->flags != search_pattern_flags(pattern) || count->use_regex != search_use_regex) return NULL;
+    return count;
+}
+
+void search_count_cancel(VteTerminal* terminal) {
+    // the terminal is going, drop any chunks still in flight
+    SearchCount* count = g_object_get_data(G_OBJECT(terminal), "search-count");
+    if (count) g_cancellable_cancel(count->cancellable);
+}
+
+void search_count_thread(GTask* task, VteTerminal* terminal, SearchCountChunk* chunk, GCancellable* cancellable) {
+    if (g_task_return_error_if_cancelled(task)) return;
+    search_scan_text(chunk->regex, chunk->text, chunk->attrs, NULL, chunk->matches);
+    g_task_return_boolean(task, TRUE);
+}
+
+void search_count_next_chunk(VteTerminal* terminal, SearchCount* count);
+
+void search_count_chunk_done(VteTerminal* terminal, GAsyncResult* result, gpointer data) {
+    if (g_cancellable_is_cancelled(g_task_get_cancellable(G_TASK(result)))) return;
+
+    SearchCountChunk* chunk = g_task_get_task_data(G_TASK(result));
+    SearchCount* count = g_object_get_data(G_OBJECT(terminal), "search-count");
+    if (! count || count->serial != chunk->serial) {
+        // superseded
+        return;
+    }
+
+    // the chunk overlaps the next one by a row so matches can wrap onto it
+    // but matches starting on that row belong to the next chunk
+    for (guint i = 0; i < chunk->matches->len; i ++) {
+        SearchMatch* match = &g_array_index(chunk->matches, SearchMatch, i);
+        if (match->row < chunk->end_row) {
+            g_array_append_val(count->matches, *match);
+        }
+    }
+    count->valid_row = MIN(chunk->end_row, count->stable_row);
+    count->next_row = chunk->end_row;
+
+    search_count_next_chunk(terminal, count);
+    search_bar_update_count(terminal);
+}
+
+void search_count_next_chunk(VteTerminal* terminal, SearchCount* count) {
+    if (count->next_row >= count->end_row) {
+        count->complete = TRUE;
+        count->generation = count->pending_generation;
+        if (search_highlight_all) {
+            gtk_widget_queue_draw(gtk_widget_get_parent(GTK_WIDGET(terminal)));
+        }
+        return;
+    }
+
+    SearchCountChunk* chunk = malloc(sizeof(SearchCountChunk));
+    chunk->serial = count->serial;
+    chunk->regex = g_regex_ref(count->regex);
+    chunk->start_row = count->next_row;
+    chunk->end_row = MIN(count->next_row + SEARCH_SCAN_CHUNK_ROWS, count->end_row);
+    chunk->attrs = g_array_new(FALSE, FALSE, sizeof(VteCharAttributes));
+    chunk->matches = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+    chunk->text = vte_terminal_get_text_range(terminal, chunk->start_row, 0, MIN(chunk->end_row+1, count->end_row), -1, NULL, NULL, chunk->attrs);
+    if (! chunk->text) chunk->text = strdup("");
+
+    GTask* task = g_task_new(terminal, count->cancellable, (GAsyncReadyCallback)search_count_chunk_done, NULL);
+    g_task_set_task_data(task, chunk, (GDestroyNotify)search_count_chunk_free);
+    g_task_run_in_thread(task, (GTaskThreadFunc)search_count_thread);
+    g_object_unref(task);
+}
+
+void search_count_update(VteTerminal* terminal, const char* pattern) {
+    /*
+     * (re)count matches of pattern in the background
+     * does nothing if the count is already up to date
+     */
+
+    if (! pattern || ! *pattern) return;
+
+    guint generation = term_get_contents_generation(terminal);
+    SearchCount* count = search_count_get(terminal, pattern);
+    if (count && count->complete && count->generation == generation) return;
+    if (count && ! count->complete && count->pending_generation == generation) return;
+
+    guint32 flags = search_pattern_flags(pattern);
+    GRegex* regex = regex_cache_lookup_gregex(pattern, flags, search_use_regex);
+    if (! regex) return;
+
+    int lower, upper;
+    term_get_row_positions(terminal, NULL, NULL, &lower, &upper);
+
+    if (! count) {
+        count = g_object_get_data(G_OBJECT(terminal), "search-count");
+        if (! count) {
+            count = calloc(1, sizeof(SearchCount));
+            count->matches = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+            count->cancellable = g_cancellable_new();
+            g_object_set_data_full(G_OBJECT(terminal), "search-count", count, (GDestroyNotify)search_count_free);
+        }
+        // different pattern, start from scratch
+        free(count->pattern);
+        count->pattern = strdup(pattern);
+        count->flags = flags;
+        count->use_regex = search_use_regex;
+        g_array_set_size(count->matches, 0);
+        count->valid_row = lower;
+    }
+
+    if (count->regex != regex) {
+        if (count->regex) g_regex_unref(count->regex);
+        count->regex = g_regex_ref(regex);
+    }
+
+    if (count->valid_row > upper) {
+        // the buffer has been reset
+        g_array_set_size(count->matches, 0);
+        count->valid_row = lower;
+    }
+
+    // drop anything that scrolled out of the scrollback
+    guint trimmed = 0;
+    while (trimmed < count->matches->len && g_array_index(count->matches, SearchMatch, trimmed).row < lower) {
+        trimmed ++;
+    }
+    g_array_remove_range(count->matches, 0, trimmed);
+
+    // rescan from the row before the last valid one in case a match wraps across it
+    glong start = MAX(lower, count->valid_row - 1);
+    while (count->matches->len) {
+        SearchMatch* match = &g_array_index(count->matches, SearchMatch, count->matches->len-1);
+        if (match->end_row < start) break;
+        start = MIN(start, match->row);
+        g_array_set_size(count->matches, count->matches->len-1);
+    }
+
+    count->serial ++;
+    count->complete = FALSE;
+    count->valid_row = start;
+    count->next_row = start;
+    count->end_row = upper;
+    // anything on screen may still change
+    count->stable_row = MAX(lower, upper - vte_terminal_get_row_count(terminal));
+    count->pending_generation = generation;
+    search_count_next_chunk(terminal, count);
+}
+
+int search_count_find(SearchCount* count, glong row, glong col) {
+    // index of the first match at or after row, col
+    int lo = 0, hi = count->matches->len;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        SearchMatch* match = &g_array_index(count->matches, SearchMatch, mid);
+        if (match->row < row || (match->row == row && match->col < col)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int search_count_selected(SearchCount* count, VteTerminal* terminal) {
+    // index of the match that is currently selected, or -1
+    TermSelection* selection = term_get_selection(terminal);
+    if (! selection->has_bounds || term_selection_is_empty(terminal)) return -1;
+
+    int index = search_count_find(count, selection->start_row, selection->start_col);
+    if (index >= count->matches->len) return -1;
+    SearchMatch* match = &g_array_index(count->matches, SearchMatch, index);
+    if (match->row == selection->start_row
+            && match->col == selection->start_col
+            && match->end_row == selection->end_row
+            && match->end_col == selection->end_col) {
+        return index;
+    }
+    return -1;
+}
+
+gboolean search_count_select(SearchCount* count, VteTerminal* terminal, int direction) {
+    /*
+     * select the next (direction > 0) or previous match
+     * straight from the counted matches instead of having vte search again
+     */
+    int len = count->matches->len;
+    if (! len) return FALSE;
+
+    int screen_lower, screen_upper, lower;
+    term_get_row_positions(terminal, &screen_lower, &screen_upper, &lower, NULL);
+
+    int index = search_count_selected(count, terminal);
+    if (index >= 0) {
+        index += direction > 0 ? 1 : -1;
+    } else if (direction > 0) {
+        index = search_count_find(count, screen_lower, 0);
+    } else {
+        index = search_count_find(count, screen_upper, 0) - 1;
+    }
+
+    if (index < 0 || index >= len) {
+        if (! search_wrap_around) return FALSE;
+        index = (index + len) % len;
+    }
+
+    SearchMatch* match = &g_array_index(count->matches, SearchMatch, index);
+    term_select_range(terminal, match->col, match->row - lower, match->end_col, match->end_row - lower, 0, FALSE);
+    return TRUE;
+}
+
+void search_count_draw(VteTerminal* terminal, GtkWidget* widget, cairo_t* cr) {
+    // highlight all the matches on screen
+    SearchCount* count = search_count_get(terminal, g_object_get_data(G_OBJECT(terminal), "search-pattern"));
+    if (! count || ! count->matches->len) return;
+
+    int x, y;
+    if (! gtk_widget_translate_coordinates(GTK_WIDGET(terminal), widget, 0, 0, &x, &y)) return;
+    GtkBorder padding;
+    GtkStyleContext* context = gtk_widget_get_style_context(GTK_WIDGET(terminal));
+    gtk_style_context_get_padding(context, gtk_style_context_get_state(context), &padding);
+    x += padding.left;
+    y += padding.top;
+
+    int width = vte_terminal_get_char_width(terminal);
+    int height = vte_terminal_get_char_height(terminal);
+    long columns = vte_terminal_get_column_count(terminal);
+    GtkAdjustment* adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal));
+    double value = gtk_adjustment_get_value(adj);
+    double end = value + gtk_adjustment_get_page_size(adj);
+
+    cairo_save(cr);
+    gdk_cairo_set_source_rgba(cr, &search_highlight_colour);
+    // matches very rarely span more than a couple of rows
+    for (int i = search_count_find(count, value - 1, 0); i < count->matches->len; i ++) {
+        SearchMatch* match = &g_array_index(count->matches, SearchMatch, i);
+        if (match->row >= end) break;
+
+        for (glong row = match->row; row <= match->end_row; row ++) {
+            if (row < value || row >= end) continue;
+            glong start_col = row == match->row ? match->col : 0;
+            glong end_col = row == match->end_row ? match->end_col : columns;
+            cairo_rectangle(cr, x + start_col * width, y + (row - value) * height, (end_col - start_col) * width, height);
+        }
+    }
+    cairo_fill(cr);
+    cairo_restore(cr);
+}
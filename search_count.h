@@ -0,0 +1,39 @@
+#ifndef SEARCH_COUNT_H
+#define SEARCH_COUNT_H
+
+#include <vte/vte.h>
+
+typedef struct {
+    char* pattern;
+    guint32 flags;
+    gboolean use_regex;
+    GRegex* regex;
+
+    // sorted SearchMatch
+    GArray* matches;
+    // matches starting before this row are final, the rows above it are in the scrollback
+    glong valid_row;
+    // contents generation the matches were counted against
+    guint generation;
+    gboolean complete;
+
+    // bumped to discard chunks that are still in flight
+    guint serial;
+    glong next_row;
+    glong end_row;
+    glong stable_row;
+    guint pending_generation;
+    // cancelled when the terminal is destroyed
+    GCancellable* cancellable;
+} SearchCount;
+
+void search_count_update(VteTerminal* terminal, const char* pattern);
+void search_count_cancel(VteTerminal* terminal);
+SearchCount* search_count_get(VteTerminal* terminal, const char* pattern);
+#define search_count_is_current(count, terminal) ((count) && (count)->complete && (count)->generation == term_get_contents_generation(terminal))
+int search_count_find(SearchCount* count, glong row, glong col);
+int search_count_selected(SearchCount* count, VteTerminal* terminal);
+gboolean search_count_select(SearchCount* count, VteTerminal* terminal, int direction);
+void search_count_draw(VteTerminal* terminal, GtkWidget* widget, cairo_t* cr);
+
+#endif
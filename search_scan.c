@@ -0,0 +1,159 @@
+#include <string.h>
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#include "search_scan.h"
+#include "terminal.h"
+#include "regex_cache.h"
+#include "config.h"
+#include "utils.h"
+
+/*
+ * incremental scrollback search
+ * fetches + matches the text a chunk of rows at a time from an idle source
+ * so that e.g. typing in the search bar never waits for the whole scrollback
+ */
+
+typedef struct {
+    glong start;
+    glong end;
+} RowRange;
+
+#define ROW_KEY(row) GINT_TO_POINTER((row)+1)
+
+void search_scan_text(GRegex* regex, const char* text, GArray* attrs, GHashTable* candidates, GArray* matches) {
+    /*
+     * find all matches in text
+     * attrs has one entry per byte of text and is used to map offsets back to rows/columns
+     * safe to call from any thread
+     */
+    GMatchInfo* info;
+    g_regex_match_full(regex, text, -1, 0, 0, &info, NULL);
+
+    while (g_match_info_matches(info)) {
+        int start, end;
+        g_match_info_fetch_pos(info, 0, &start, &end);
+
+        if (start < end && end <= attrs->len) {
+            VteCharAttributes* first = &g_array_index(attrs, VteCharAttributes, start);
+            VteCharAttributes* last = &g_array_index(attrs, VteCharAttributes, end-1);
+            if (! candidates || g_hash_table_contains(candidates, ROW_KEY(first->row))) {
+                SearchMatch match = {first->row, first->column, last->row, last->column + MAX(1, last->columns)};
+                g_array_append_val(matches, match);
+            }
+        }
+        g_match_info_next(info, NULL);
+    }
+    g_match_info_free(info);
+}
+
+gint search_match_compare(const SearchMatch* a, const SearchMatch* b) {
+    if (a->row != b->row) return a->row < b->row ? -1 : 1;
+    if (a->col != b->col) return a->col < b->col ? -1 : 1;
+    return 0;
+}
+
+gboolean search_scan_step(SearchScan* scan) {
+    if (scan->ranges->len == 0) {
+        g_array_sort(scan->matches, (GCompareFunc)search_match_compare);
+        scan->complete = TRUE;
+        scan->source = 0;
+        scan->callback(scan, scan->data);
+        return G_SOURCE_REMOVE;
+    }
+
+    // work bottom up, recent output is more interesting
+    RowRange* range = &g_array_index(scan->ranges, RowRange, scan->ranges->len-1);
+    glong start = MAX(range->start, range->end - SEARCH_SCAN_CHUNK_ROWS);
+    glong end = range->end;
+    range->end = start;
+    if (range->start >= range->end) {
+        g_array_remove_index(scan->ranges, scan->ranges->len-1);
+    }
+
+    GArray* attrs = g_array_new(FALSE, FALSE, sizeof(VteCharAttributes));
+    char* text = vte_terminal_get_text_range(scan->terminal, start, 0, end, -1, NULL, NULL, attrs);
+    guint found = scan->matches->len;
+    if (text) {
+        search_scan_text(scan->regex, text, attrs, scan->candidates, scan->matches);
+    }
+    free(text);
+    g_array_free(attrs, TRUE);
+
+    if (scan->matches->len > found) {
+        scan->callback(scan, scan->data);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean search_scan_can_refine(SearchScan* previous, VteTerminal* terminal, const char* pattern, guint32 flags) {
+    /*
+     * every match of a literal pattern starts with a match of any literal prefix of it
+     * so only rows where the previous pattern matched need to be rescanned
+     */
+    return previous
+        && previous->complete
+        && previous->terminal == terminal
+        && previous->generation == term_get_contents_generation(terminal)
+        && ! previous->use_regex
+        && ! search_use_regex
+        && g_str_has_prefix(pattern, previous->pattern)
+        // caseless matches are a superset of case sensitive ones, but not the other way around
+        && ((previous->flags & PCRE2_CASELESS) || ! (flags & PCRE2_CASELESS));
+}
+
+SearchScan* search_scan_start(VteTerminal* terminal, const char* pattern, SearchScan* previous, SearchScanCallback callback, gpointer data) {
+    guint32 flags = search_pattern_flags(pattern);
+    GRegex* regex = regex_cache_lookup_gregex(pattern, flags, search_use_regex);
+    if (! regex) return NULL;
+
+    SearchScan* scan = malloc(sizeof(SearchScan));
+    scan->terminal = terminal;
+    scan->pattern = strdup(pattern);
+    scan->flags = flags;
+    scan->use_regex = search_use_regex;
+    scan->regex = g_regex_ref(regex);
+    scan->generation = term_get_contents_generation(terminal);
+    scan->ranges = g_array_new(FALSE, FALSE, sizeof(RowRange));
+    scan->candidates = NULL;
+    scan->matches = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+    scan->complete = FALSE;
+    scan->callback = callback;
+    scan->data = data;
+
+    if (search_scan_can_refine(previous, terminal, pattern, flags)) {
+        scan->candidates = g_hash_table_new(g_direct_hash, g_direct_equal);
+        for (int i = 0; i < previous->matches->len; i ++) {
+            SearchMatch* match = &g_array_index(previous->matches, SearchMatch, i);
+            g_hash_table_add(scan->candidates, ROW_KEY(match->row));
+
+            // the longer pattern may carry on past the end of the old match
+            RowRange range = {match->row, match->end_row + 2};
+            RowRange* last = scan->ranges->len ? &g_array_index(scan->ranges, RowRange, scan->ranges->len-1) : NULL;
+            if (last && range.start <= last->end) {
+                last->end = MAX(last->end, range.end);
+            } else {
+                g_array_append_val(scan->ranges, range);
+            }
+        }
+
+    } else {
+        int lower, upper;
+        term_get_row_positions(terminal, NULL, NULL, &lower, &upper);
+        RowRange range = {lower, upper};
+        g_array_append_val(scan->ranges, range);
+    }
+
+    scan->source = g_idle_add((GSourceFunc)search_scan_step, scan);
+    return scan;
+}
+
+void search_scan_free(SearchScan* scan) {
+    if (! scan) return;
+    if (scan->source) g_source_remove(scan->source);
+    g_regex_unref(scan->regex);
+    g_array_free(scan->ranges, TRUE);
+    g_array_free(scan->matches, TRUE);
+    if (scan->candidates) g_hash_table_destroy(scan->candidates);
+    free(scan->pattern);
+    free(scan);
+}
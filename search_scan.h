@@ -0,0 +1,46 @@
+#ifndef SEARCH_SCAN_H
+#define SEARCH_SCAN_H
+
+#include <vte/vte.h>
+
+// rows fetched + matched per idle iteration
+#define SEARCH_SCAN_CHUNK_ROWS 500
+
+typedef struct {
+    glong row;
+    glong col;
+    glong end_row;
+    // exclusive
+    glong end_col;
+} SearchMatch;
+
+typedef struct search_scan SearchScan;
+typedef void(*SearchScanCallback)(SearchScan*, gpointer);
+
+struct search_scan {
+    VteTerminal* terminal;
+    char* pattern;
+    guint32 flags;
+    gboolean use_regex;
+    GRegex* regex;
+    guint generation;
+
+    // [start, end) row ranges still to scan, the last one is scanned first
+    GArray* ranges;
+    // when refining a previous scan, only matches starting on these rows count
+    GHashTable* candidates;
+
+    // sorted once complete
+    GArray* matches;
+    gboolean complete;
+    guint source;
+
+    SearchScanCallback callback;
+    gpointer data;
+};
+
+void search_scan_text(GRegex* regex, const char* text, GArray* attrs, GHashTable* candidates, GArray* matches);
+SearchScan* search_scan_start(VteTerminal* terminal, const char* pattern, SearchScan* previous, SearchScanCallback callback, gpointer data);
+void search_scan_free(SearchScan* scan);
+
+#endif
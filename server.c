@@ -5,6 +5,8 @@
 #include "window.h"
 #include "utils.h"
 #include "action.h"
+#include "worker.h"
+#include "scrollback_log.h"
 
 void finalise_pipe_socket(GSocket* sock) {
     int stdout = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(sock), "stdout"));
@@ -89,6 +91,122 @@ void server_pipe_over_socket(GSocket* sock, char* value, Buffer* remainder) {
     }
 }
 
+void server_deferred_reply(char* result, GSocket* sock);
+void server_deferred_reply_with_fd(char* result, int fd, GSocket* sock);
+
+gboolean server_send_reply(GSocket* sock, char* data, int fd) {
+    int result;
+    if (fd >= 0) {
+        result = sock_send_all_with_fd(sock, data ? data : "", data ? strlen(data)+1 : 1, fd);
+        // the receiver has its own copy now
+        close(fd);
+    } else if (data) {
+        result = sock_send_all(sock, data, strlen(data)+1);
+    } else {
+        result = sock_send_all(sock, "", 1);
+    }
+    free(data);
+    return result;
+}
+
+int server_handle_lines(GSocket* sock, Buffer* buffer, char* start) {
+    while (buffer->used > 0) {
+        char* end = buffer->data + buffer->used;
+        // search for \0 or \n
+        char* ptr;
+        for (ptr = start; ptr < end && *ptr != 0 && *ptr != '\n'; ptr++) ;
+        // no terminator found
+        if (ptr == end) break;
+
+        *ptr = '\0'; // end of line
+        char *sock_connect;
+        if ((sock_connect = STR_STRIP_PREFIX(buffer->data, CONNECT_SOCK))) {
+            // dup as the shift below will invalidate the data
+            sock_connect = strdup(sock_connect);
+            // shift by length of line
+            buffer_shift_back(buffer, ptr - buffer->data + 1);
+            if (is_coordinator) {
+                coordinator_pipe_over_socket(sock, sock_connect, buffer);
+            } else {
+                server_pipe_over_socket(sock, sock_connect, buffer);
+            }
+            free(sock_connect);
+
+            return G_SOURCE_REMOVE;
+        }
+
+        if (is_coordinator && STR_STARTSWITH(buffer->data, WORKER_FOCUS_COMMAND)) {
+            // fire and forget, no reply
+            int fd;
+            gboolean deferred;
+            coordinator_execute_line(buffer->data, ptr - buffer->data, &fd, NULL, NULL, &deferred);
+            buffer_shift_back(buffer, ptr - buffer->data + 1);
+            start = buffer->data;
+            continue;
+        }
+
+        void* data;
+        int fd;
+        gboolean deferred;
+        if (is_coordinator) {
+            // forwarded lines are answered once the worker replies
+            data = coordinator_execute_line(buffer->data, ptr - buffer->data, &fd, (WorkerReplyFunc)server_deferred_reply_with_fd, sock, &deferred);
+        } else {
+            // actions that take a while can reply later through server_deferred_reply
+            data = execute_line_deferred(buffer->data, ptr - buffer->data, (DeferredResultFunc)server_deferred_reply, sock, &deferred);
+            fd = take_pending_snapshot_fd();
+        }
+
+        if (deferred) {
+            if (fd >= 0) close(fd);
+            free(data);
+            buffer_shift_back(buffer, ptr - buffer->data + 1);
+
+            // stop reading until the reply is sent so replies stay in order
+            // the source owns buffer, so keep a copy of anything left over
+            Buffer* remainder = buffer_new(buffer->reserved);
+            memcpy(remainder->data, buffer->data, buffer->used);
+            remainder->used = buffer->used;
+            g_object_set_data_full(G_OBJECT(sock), "deferred-buffer", remainder, (GDestroyNotify)buffer_free);
+            g_object_ref(sock);
+            return G_SOURCE_REMOVE;
+        }
+
+        // sock_send_all closes the socket on failure
+        if (! server_send_reply(sock, data, fd)) {
+            return G_SOURCE_REMOVE;
+        }
+
+        // shift by length of line
+        buffer_shift_back(buffer, ptr - buffer->data + 1);
+        // search from beginning now
+        start = buffer->data;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void server_deferred_reply(char* result, GSocket* sock) {
+    server_deferred_reply_with_fd(result, -1, sock);
+}
+
+void server_deferred_reply_with_fd(char* result, int fd, GSocket* sock) {
+    Buffer* buffer = g_object_steal_data(G_OBJECT(sock), "deferred-buffer");
+
+    if (server_send_reply(sock, result, fd)) {
+        // carry on with anything that arrived in the meantime
+        if (server_handle_lines(sock, buffer, buffer->data) == G_SOURCE_CONTINUE) {
+            GSource* source = g_socket_create_source(sock, G_IO_IN | G_IO_ERR, NULL);
+            g_source_set_callback(source, (GSourceFunc)server_recv, buffer, (GDestroyNotify)buffer_free);
+            g_source_attach(source, NULL);
+            g_source_unref(source);
+            buffer = NULL;
+        }
+    }
+
+    if (buffer) buffer_free(buffer);
+    g_object_unref(sock);
+}
+
 int server_recv(GSocket* sock, GIOCondition io, Buffer* buffer) {
     if (io & G_IO_IN) {
         GError* error = NULL;
@@ -104,46 +222,9 @@ int server_recv(GSocket* sock, GIOCondition io, Buffer* buffer) {
             g_error_free(error);
 
         } else if (len >= 0) {
-            char* start = buffer->data + buffer->used - len;
-
-            while (buffer->used > 0) {
-                char* end = buffer->data + buffer->used;
-                // search for \0 or \n
-                char* ptr;
-                for (ptr = start; ptr < end && *ptr != 0 && *ptr != '\n'; ptr++) ;
-                // no terminator found
-                if (ptr == end) break;
-
-                *ptr = '\0'; // end of line
-                char *sock_connect;
-                if ((sock_connect = STR_STRIP_PREFIX(buffer->data, CONNECT_SOCK))) {
-                    // dup as the shift below will invalidate the data
-                    sock_connect = strdup(sock_connect);
-                    // shift by length of line
-                    buffer_shift_back(buffer, ptr - buffer->data + 1);
-                    server_pipe_over_socket(sock, sock_connect, buffer);
-                    free(sock_connect);
-
-                    return G_SOURCE_REMOVE;
-                }
-
-                void* data = execute_line(buffer->data, ptr - buffer->data, TRUE, TRUE);
-                int result;
-                if (data) {
-                    result = sock_send_all(sock, data, strlen(data)+1);
-                } else {
-                    result = sock_send_all(sock, "", 1);
-                }
-                free(data);
-
-                if (! result) {
-                    return 1;
-                }
-
-                // shift by length of line
-                buffer_shift_back(buffer, ptr - buffer->data + 1);
-                // search from beginning now
-                start = buffer->data;
+            int status = server_handle_lines(sock, buffer, buffer->data + buffer->used - len);
+            if (status != G_SOURCE_CONTINUE) {
+                return status;
             }
 
             if (len == 0) {
@@ -172,12 +253,17 @@ int run_server(int argc, char** argv) {
     gtk_style_context_add_provider_for_screen(screen, GTK_STYLE_PROVIDER(css_provider), GTK_STYLE_PROVIDER_PRIORITY_APPLICATION + 1);
 
     config_load_from_file(config_filename, TRUE);
-    GtkWidget* window = make_new_window_full(NULL, NULL, argc, argv);
+    if (worker_processes > 0 && app_id && ! g_getenv(WORKER_ENV)) {
+        return run_coordinator(argc, argv);
+    }
+
+    GtkWidget* window = worker_init(argc, argv);
     VteTerminal* terminal = get_active_terminal(window);
     trigger_action(terminal, EVENT_KEY, START_EVENT);
     trigger_action(terminal, EVENT_KEY, CONFIG_LOAD_EVENT);
 
     g_unix_signal_add(SIGINT, (GSourceFunc)gtk_main_quit, NULL);
     gtk_main();
+    scrollback_log_shutdown();
     return 0;
 }
@@ -1,7 +1,11 @@
 #include <errno.h>
+#include <gio/gunixfdmessage.h>
 #include "socket.h"
 #include "config.h"
 
+// every live buffer, for memory_stats
+GPtrArray* live_buffers = NULL;
+
 void buffer_shift_back(Buffer* buffer, int offset) {
     int length = buffer->used - offset;
     if (length > 0) {
@@ -26,14 +30,42 @@ Buffer* buffer_new(int size) {
     buffer->reserved = 0;
     buffer->data = NULL;
     buffer_reserve(buffer, size);
+
+    if (! live_buffers) live_buffers = g_ptr_array_new();
+    g_ptr_array_add(live_buffers, buffer);
     return buffer;
 }
 
 void buffer_free(Buffer* buffer) {
+    g_ptr_array_remove_fast(live_buffers, buffer);
     free(buffer->data);
     free(buffer);
 }
 
+void buffer_stats(guint* count, gsize* used, gsize* reserved) {
+    *count = live_buffers ? live_buffers->len : 0;
+    *used = *reserved = 0;
+    for (guint i = 0; i < *count; i ++) {
+        Buffer* buffer = live_buffers->pdata[i];
+        *used += buffer->used;
+        *reserved += buffer->reserved;
+    }
+}
+
+gsize buffer_shrink_all(int threshold) {
+    // shrink buffers that have grown past threshold back down, returns bytes released
+    gsize released = 0;
+    for (guint i = 0; live_buffers && i < live_buffers->len; i ++) {
+        Buffer* buffer = live_buffers->pdata[i];
+        int size = MAX(buffer->used, BUFFER_DEFAULT_SIZE);
+        if (buffer->reserved > threshold && buffer->reserved > size) {
+            released += buffer->reserved - size;
+            buffer_reserve(buffer, size);
+        }
+    }
+    return released;
+}
+
 int write_to_fd(int fd, char* buffer, ssize_t size) {
     ssize_t written = 0;
     while (written < size) {
@@ -223,6 +255,51 @@ gboolean sock_send_all(GSocket* sock, char* buffer, int size) {
     return TRUE;
 }
 
+gboolean sock_send_all_with_fd(GSocket* sock, char* buffer, int size, int fd) {
+    // attach fd (SCM_RIGHTS) to the first chunk, then send the rest as usual
+    GError* error = NULL;
+    GSocketControlMessage* message = g_unix_fd_message_new();
+    if (! g_unix_fd_message_append_fd(G_UNIX_FD_MESSAGE(message), fd, &error)) {
+        g_warning("Failed to attach fd: %s", error->message);
+        g_error_free(error);
+        g_object_unref(message);
+        return sock_send_all(sock, buffer, size);
+    }
+
+    GOutputVector vector = {buffer, size};
+    int result = g_socket_send_message(sock, NULL, &vector, 1, &message, 1, 0, NULL, &error);
+    g_object_unref(message);
+    if (result < 0) {
+        if (error->domain != G_IO_ERROR || error->code != G_IO_ERROR_BROKEN_PIPE) {
+            g_warning("Failed on sendmsg(): %s", error->message);
+        }
+        g_error_free(error);
+        close_socket(sock);
+        return FALSE;
+    }
+    return sock_send_all(sock, buffer + result, size - result);
+}
+
+void sock_take_fds(GSocketControlMessage** messages, int nmessages, int* fd) {
+    // keep the first fd passed (SCM_RIGHTS) if *fd is not already set, close any others
+    for (int i = 0; i < nmessages; i ++) {
+        if (G_IS_UNIX_FD_MESSAGE(messages[i])) {
+            int nfds;
+            int* fds = g_unix_fd_message_steal_fds(G_UNIX_FD_MESSAGE(messages[i]), &nfds);
+            for (int j = 0; j < nfds; j ++) {
+                if (*fd < 0) {
+                    *fd = fds[j];
+                } else {
+                    close(fds[j]);
+                }
+            }
+            g_free(fds);
+        }
+        g_object_unref(messages[i]);
+    }
+    g_free(messages);
+}
+
 char* sock_recv_until_null(GSocket* sock) {
     GError* error = NULL;
     int total_size = 1024;
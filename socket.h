@@ -19,6 +19,8 @@ void buffer_shift_back(Buffer* buffer, int offset);
 void buffer_reserve(Buffer* buffer, int size);
 Buffer* buffer_new(int size);
 void buffer_free(Buffer*);
+void buffer_stats(guint* count, gsize* used, gsize* reserved);
+gsize buffer_shrink_all(int threshold);
 
 int write_to_fd(int fd, char* buffer, ssize_t size);
 int dump_socket_to_fd(GSocket* sock, GIOCondition io, int fd);
@@ -29,6 +31,8 @@ int connect_sock(GSocket* sock, GSocketAddress* addr);
 gboolean shutdown_socket(GSocket* sock, gboolean shutdown_read, gboolean shutdown_write);
 gboolean close_socket(GSocket* sock);
 gboolean sock_send_all(GSocket* sock, char* buffer, int size);
+gboolean sock_send_all_with_fd(GSocket* sock, char* buffer, int size, int fd);
+void sock_take_fds(GSocketControlMessage** messages, int nmessages, int* fd);
 char* sock_recv_until_null(GSocket* sock);
 
 #endif
@@ -3,6 +3,7 @@
 #include "tab_title_ui.h"
 #include "utils.h"
 #include "label.h"
+#include "memory.h"
 
 #define RESIZE TRUE
 #define SHRINK FALSE
@@ -74,6 +75,7 @@ GtkWidget* split(GtkWidget* dest, GtkWidget* src, GtkOrientation orientation, gb
 void split_cleanup(GtkWidget* paned) {
     GtkWidget *child1, *child2;
     gtk_paned_get_children(GTK_PANED(paned), &child1, &child2);
+    memory_reclaim_later();
 
     if (!child1 && !child2) {
         // no children, this can only be the root, so destroy everything
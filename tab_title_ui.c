@@ -30,6 +30,9 @@ typedef struct {
 } FormatObject;
 GArray* widget_formatters = NULL;
 
+void unregister_widget(GtkWidget* widget);
+void register_widget_parsed(GtkWidget* widget, GtkWidget* root_split, const char* prop, TitleFormat format, gboolean escaped);
+
 gboolean validate_ui_definition(const char* string) {
     GtkBuilder* builder = gtk_builder_new();
     GError* error = NULL;
@@ -63,27 +66,375 @@ gboolean set_tab_label_format(char* string, PangoEllipsizeMode ellipsize, float
             ellipsize_str = "none"; break;
     }
 
-    return set_tab_title_ui(g_markup_printf_escaped(DEFAULT_UI, string, ellipsize_str, xalign));
+    char* ui = g_markup_printf_escaped(DEFAULT_UI, string, ellipsize_str, xalign);
+    gboolean result = set_tab_title_ui(ui);
+    g_free(ui);
+    return result;
 }
 
-gboolean set_tab_title_ui(char* string) {
-    // return TRUE if changed
+/*
+ * TEMPLATES
+ * the ui definition is parsed once into a tree of widget types, property values
+ * and format: bindings so tabs can be created without going through GtkBuilder
+ * anything this doesn't understand (packing, styles, object references etc)
+ * falls back to running GtkBuilder for every tab
+ */
 
-    if (! validate_ui_definition(string)) {
-        return FALSE;
+typedef struct {
+    char* name;
+    GValue value;
+    // can only be passed to g_object_new
+    gboolean construct_only;
+} TitleProperty;
+
+typedef struct {
+    char* property;
+    TitleFormat format;
+    gboolean escaped;
+} TitleBinding;
+
+typedef struct TitleNode {
+    GType type;
+    GArray* properties;
+    GArray* bindings;
+    GPtrArray* children;
+    struct TitleNode* parent;
+    // for the property currently being parsed
+    char* property;
+    GString* text;
+} TitleNode;
+
+typedef struct {
+    GtkBuilder* builder;
+    TitleNode* root;
+    TitleNode* current;
+    gboolean unsupported;
+    int depth;
+    int ignore_depth;
+} TitleTemplateParser;
+
+TitleNode* title_template = NULL;
+
+void title_node_free(TitleNode* node) {
+    if (! node) return;
+    for (int i = 0; i < node->properties->len; i ++) {
+        TitleProperty* prop = &g_array_index(node->properties, TitleProperty, i);
+        free(prop->name);
+        g_value_unset(&prop->value);
+    }
+    for (int i = 0; i < node->bindings->len; i ++) {
+        TitleBinding* binding = &g_array_index(node->bindings, TitleBinding, i);
+        free(binding->property);
+        free(binding->format.format);
+    }
+    g_array_free(node->properties, TRUE);
+    g_array_free(node->bindings, TRUE);
+    g_ptr_array_free(node->children, TRUE);
+    free(node->property);
+    if (node->text) g_string_free(node->text, TRUE);
+    free(node);
+}
+
+TitleProperty* title_node_find_property(TitleNode* node, const char* name) {
+    for (int i = node->properties->len - 1; i >= 0; i --) {
+        TitleProperty* prop = &g_array_index(node->properties, TitleProperty, i);
+        if (STR_EQUAL(prop->name, name)) {
+            return prop;
+        }
     }
+    return NULL;
+}
+
+void title_template_start_element(
+        GMarkupParseContext* context,
+        const char* element,
+        const char** names,
+        const char** values,
+        TitleTemplateParser* parser,
+        GError** error
+) {
+    parser->depth ++;
+    // inside another top level object, ignored like GtkBuilder does
+    if (parser->ignore_depth) return;
+
+    TitleNode* node = parser->current;
+
+#define FIND_ATTRIBUTE(var, name) \
+    const char* var = NULL; \
+    for (int i = 0; names[i]; i ++) { \
+        if (STR_EQUAL(names[i], name)) var = values[i]; \
+    }
+
+    if (STR_EQUAL(element, "interface") || STR_EQUAL(element, "requires")) {
+        return;
+
+    } else if (STR_EQUAL(element, "child")) {
+        // plain children only, no internal children or packing
+        if (! node || names[0]) parser->unsupported = TRUE;
+        return;
+
+    } else if (STR_EQUAL(element, "object")) {
+        if (! node && parser->root) {
+            parser->ignore_depth = parser->depth;
+            return;
+        }
+
+        FIND_ATTRIBUTE(class_name, "class");
+        GType type = class_name ? gtk_builder_get_type_from_name(parser->builder, class_name) : G_TYPE_INVALID;
+        if (! g_type_is_a(type, GTK_TYPE_WIDGET) || (node && ! g_type_is_a(node->type, GTK_TYPE_CONTAINER))) {
+            parser->unsupported = TRUE;
+            return;
+        }
+
+        // make sure the class exists so its properties can be looked up
+        g_type_class_unref(g_type_class_ref(type));
+
+        TitleNode* child = calloc(1, sizeof(TitleNode));
+        child->type = type;
+        child->properties = g_array_new(FALSE, TRUE, sizeof(TitleProperty));
+        child->bindings = g_array_new(FALSE, TRUE, sizeof(TitleBinding));
+        child->children = g_ptr_array_new_with_free_func((GDestroyNotify)title_node_free);
+        child->parent = node;
+        if (node) {
+            g_ptr_array_add(node->children, child);
+        } else {
+            parser->root = child;
+        }
+        parser->current = child;
+
+    } else if (STR_EQUAL(element, "property") && node) {
+        FIND_ATTRIBUTE(name, "name");
+        FIND_ATTRIBUTE(bind_source, "bind-source");
+        if (! name || bind_source) {
+            parser->unsupported = TRUE;
+            return;
+        }
+        node->property = strdup(name);
+        node->text = g_string_new(NULL);
+
+    } else if (STR_EQUAL(element, "signal") && node) {
+        FIND_ATTRIBUTE(handler, "handler");
+        const char* prop;
+        if (handler && (prop = STR_STRIP_PREFIX(handler, "format:"))) {
+            gboolean escaped = FALSE;
+            const char* end;
+            if ((end = STR_STRIP_PREFIX(prop, "escaped:"))) {
+                prop = end;
+                escaped = TRUE;
+            }
+            // format string is filled in from the property at the end of the object
+            TitleBinding binding = {strdup(prop), {0, NULL}, escaped};
+            g_array_append_val(node->bindings, binding);
+        }
+        // other signals not really supported, see builder_widget_connector
+
+    } else {
+        // packing, style, attributes etc
+        parser->unsupported = TRUE;
+    }
+}
+
+void title_template_text(GMarkupParseContext* context, const char* text, gsize length, TitleTemplateParser* parser, GError** error) {
+    if (! parser->ignore_depth && parser->current && parser->current->text) {
+        g_string_append_len(parser->current->text, text, length);
+    }
+}
+
+void title_template_end_element(GMarkupParseContext* context, const char* element, TitleTemplateParser* parser, GError** error) {
+    int depth = parser->depth --;
+    if (parser->ignore_depth) {
+        if (parser->ignore_depth == depth) parser->ignore_depth = 0;
+        return;
+    }
+
+    TitleNode* node = parser->current;
+    if (! node || parser->unsupported) return;
+
+    if (STR_EQUAL(element, "property") && node->property) {
+        GParamSpec* pspec = g_object_class_find_property(g_type_class_peek(node->type), node->property);
+        if (! pspec || G_TYPE_IS_OBJECT(pspec->value_type) || G_TYPE_IS_INTERFACE(pspec->value_type)) {
+            // e.g. references to other objects
+            parser->unsupported = TRUE;
+        } else {
+            TitleProperty prop = {strdup(node->property), G_VALUE_INIT, pspec->flags & G_PARAM_CONSTRUCT_ONLY};
+            TitleProperty* existing = title_node_find_property(node, prop.name);
+            if (! gtk_builder_value_from_string(parser->builder, pspec, node->text->str, &prop.value, error)) {
+                free(prop.name);
+            } else if (existing) {
+                // last one wins, g_object_new does not allow repeats
+                free(prop.name);
+                g_value_unset(&existing->value);
+                existing->value = prop.value;
+            } else {
+                g_array_append_val(node->properties, prop);
+            }
+        }
+        free(node->property);
+        node->property = NULL;
+        g_string_free(node->text, TRUE);
+        node->text = NULL;
+
+    } else if (STR_EQUAL(element, "object")) {
+        for (int i = 0; i < node->bindings->len; i ++) {
+            TitleBinding* binding = &g_array_index(node->bindings, TitleBinding, i);
+            TitleProperty* prop = title_node_find_property(node, binding->property);
+            if (! prop || ! G_VALUE_HOLDS_STRING(&prop->value)) {
+                parser->unsupported = TRUE;
+                break;
+            }
+            char* format = g_value_dup_string(&prop->value);
+            binding->format = parse_title_format(format ? format : (char*)"");
+            g_free(format);
+            // the property itself gets filled in by the formatter
+            g_value_set_string(&prop->value, "");
+        }
+        parser->current = node->parent;
+    }
+}
+
+int title_template_parse(const char* string, TitleNode** result) {
+    /*
+     * returns 1 and sets result if parsed
+     * 0 if valid but needs GtkBuilder, -1 if invalid
+     */
+    static GtkBuilder* builder = NULL;
+    if (! builder) builder = gtk_builder_new();
+
+    GMarkupParser markup_parser = {
+        (void*)title_template_start_element,
+        (void*)title_template_end_element,
+        (void*)title_template_text,
+        NULL,
+        NULL,
+    };
+    TitleTemplateParser parser = {builder, NULL, NULL, FALSE, 0, 0};
+    GMarkupParseContext* context = g_markup_parse_context_new(&markup_parser, 0, &parser, NULL);
+
+    GError* error = NULL;
+    gboolean success = g_markup_parse_context_parse(context, string, -1, &error) && g_markup_parse_context_end_parse(context, &error);
+    g_markup_parse_context_free(context);
+
+    *result = NULL;
+    if (! success) {
+        g_warning("Invalid UI definition: %s", error->message);
+        g_error_free(error);
+        title_node_free(parser.root);
+        return -1;
+    }
+    if (parser.unsupported || ! parser.root) {
+        title_node_free(parser.root);
+        return 0;
+    }
+    *result = parser.root;
+    return 1;
+}
+
+gboolean title_node_same_structure(TitleNode* a, TitleNode* b) {
+    if (a->type != b->type) return FALSE;
+    if (a->properties->len != b->properties->len) return FALSE;
+    if (a->bindings->len != b->bindings->len) return FALSE;
+    if (a->children->len != b->children->len) return FALSE;
+    for (int i = 0; i < a->properties->len; i ++) {
+        if (! STR_EQUAL(g_array_index(a->properties, TitleProperty, i).name, g_array_index(b->properties, TitleProperty, i).name)) return FALSE;
+    }
+    for (int i = 0; i < a->bindings->len; i ++) {
+        if (! STR_EQUAL(g_array_index(a->bindings, TitleBinding, i).property, g_array_index(b->bindings, TitleBinding, i).property)) return FALSE;
+    }
+    for (int i = 0; i < a->children->len; i ++) {
+        if (! title_node_same_structure(a->children->pdata[i], b->children->pdata[i])) return FALSE;
+    }
+    return TRUE;
+}
+
+void title_node_bind(TitleNode* node, GtkWidget* widget, GtkWidget* paned) {
+    for (int i = 0; i < node->bindings->len; i ++) {
+        TitleBinding* binding = &g_array_index(node->bindings, TitleBinding, i);
+        TitleFormat format = {binding->format.flags, strdup(binding->format.format)};
+        register_widget_parsed(widget, paned, binding->property, format, binding->escaped);
+    }
+}
+
+GtkWidget* title_node_instantiate(TitleNode* node, GtkWidget* paned) {
+    // properties go to g_object_new so construct only ones work too
+    guint n = node->properties->len;
+    const char* names[MAX(n, 1)];
+    GValue values[MAX(n, 1)];
+    for (guint i = 0; i < n; i ++) {
+        TitleProperty* prop = &g_array_index(node->properties, TitleProperty, i);
+        names[i] = prop->name;
+        values[i] = prop->value;
+    }
+    GtkWidget* widget = GTK_WIDGET(g_object_new_with_properties(node->type, n, names, values));
+
+    title_node_bind(node, widget, paned);
+    for (int i = 0; i < node->children->len; i ++) {
+        gtk_container_add(GTK_CONTAINER(widget), title_node_instantiate(node->children->pdata[i], paned));
+    }
+    return widget;
+}
+
+gboolean title_node_update(TitleNode* node, GtkWidget* widget, GtkWidget* paned) {
+    // update a widget made from a template with the same structure
+    if (G_OBJECT_TYPE(widget) != node->type) return FALSE;
+
+    // construct only properties need a new widget
+    for (int i = 0; i < node->properties->len; i ++) {
+        if (g_array_index(node->properties, TitleProperty, i).construct_only) return FALSE;
+    }
+
+    if (widget_formatters) unregister_widget(widget);
+    for (int i = 0; i < node->properties->len; i ++) {
+        TitleProperty* prop = &g_array_index(node->properties, TitleProperty, i);
+        g_object_set_property(G_OBJECT(widget), prop->name, &prop->value);
+    }
+    title_node_bind(node, widget, paned);
+
+    gboolean result = TRUE;
+    GList* children = node->children->len ? gtk_container_get_children(GTK_CONTAINER(widget)) : NULL;
+    GList* child = children;
+    for (int i = 0; result && i < node->children->len; i ++, child = child->next) {
+        result = child && title_node_update(node->children->pdata[i], child->data, paned);
+    }
+    g_list_free(children);
+    return result;
+}
+
+gboolean set_tab_title_ui(char* string) {
+    // return TRUE if the tab titles need to be rebuilt
 
     if (tab_title_ui && STR_EQUAL(tab_title_ui, string)) {
         return FALSE;
     }
 
-    if (tab_title_ui) {
-        free(tab_title_ui);
-        tab_title_ui = NULL;
+    TitleNode* template;
+    int parsed = title_template_parse(string, &template);
+    if (parsed < 0 || (parsed == 0 && ! validate_ui_definition(string))) {
+        return FALSE;
     }
 
+    free(tab_title_ui);
     tab_title_ui = strdup(string);
-    return TRUE;
+
+    TitleNode* old_template = title_template;
+    title_template = template;
+
+    gboolean changed = TRUE;
+    if (old_template && template && title_node_same_structure(old_template, template)) {
+        // same structure, update in place
+        changed = FALSE;
+        FOREACH_WINDOW(window) {
+            FOREACH_TAB(tab, window) {
+                GtkWidget* ui = g_object_get_data(G_OBJECT(tab), "tab_title");
+                if (ui && ! g_object_get_data(G_OBJECT(ui), "placeholder") && ! title_node_update(template, ui, tab)) {
+                    changed = TRUE;
+                }
+            }
+        }
+        update_tab_titles(NULL);
+    }
+
+    title_node_free(old_template);
+    return changed;
 }
 
 void destroy_all_tab_title_uis() {
@@ -135,6 +486,27 @@ TitleFormat parse_title_format(char* string) {
                 pieces[i] = "%5$s";
                 flags |= TITLE_FORMAT_USER;
                 break;
+            case '{': { // plugin field
+                static char* plugin_pieces[PLUGIN_MAX_TITLE_FIELDS] = {"%6$s", "%7$s", "%8$s", "%9$s"};
+                char* close = strchr(end+2, '}');
+                int index = -1;
+                if (close) {
+                    *close = '\0';
+                    index = plugin_title_field_index(end+2);
+                    *close = '}';
+                }
+                if (index < 0) {
+                    if (close) g_warning("Unknown title field: %.*s", (int)(close-end+1), end);
+                    pieces[i] = "%%";
+                    end --; // back out one to include the brace next round
+                    break;
+                }
+                pieces[i] = plugin_pieces[index];
+                flags |= TITLE_FORMAT_PLUGIN;
+                // skip up to the closing brace
+                end = close - 1;
+                break;
+            }
             case '\0':
                 end --; // back out one so we don't go past end of array
             case '%':
@@ -170,13 +542,24 @@ void update_tab_titles(VteTerminal* terminal) {
         if (term_construct_title(fo->format.format, fo->format.flags, current_term, fo->escaped, buffer, sizeof(buffer)-1)) {
             char* old;
             g_object_get(G_OBJECT(fo->widget), fo->property, &old, NULL);
-            if (! STR_EQUAL(old, buffer)) {
+            if (g_strcmp0(old, buffer) != 0) {
                 g_object_set(G_OBJECT(fo->widget), fo->property, buffer, NULL);
             }
+            g_free(old);
         }
     }
 }
 
+int tab_title_formatter_count(GtkWidget* root_split) {
+    // NULL for all of them
+    int count = 0;
+    for (int i = 0; widget_formatters && i < widget_formatters->len; i ++) {
+        FormatObject* fo = &g_array_index(widget_formatters, FormatObject, i);
+        if (! root_split || fo->root_split == root_split) count ++;
+    }
+    return count;
+}
+
 void unregister_widget(GtkWidget* widget) {
     // start from end as we are modifying while iterating
     for (int i = widget_formatters->len - 1; i >= 0; i --) {
@@ -196,7 +579,11 @@ void register_widget_parsed(GtkWidget* widget, GtkWidget* root_split, const char
 
     FormatObject fo = {widget, root_split, strdup(prop), format, escaped};
     g_array_append_val(widget_formatters, fo);
-    g_signal_connect(widget, "destroy", G_CALLBACK(unregister_widget), NULL);
+    // widgets updated in place get registered again
+    if (! g_object_get_data(G_OBJECT(widget), "formatted")) {
+        g_object_set_data(G_OBJECT(widget), "formatted", GINT_TO_POINTER(TRUE));
+        g_signal_connect(widget, "destroy", G_CALLBACK(unregister_widget), NULL);
+    }
 }
 
 void register_widget(GtkWidget* widget, GtkWidget* root_split, const char* prop, const char* format, gboolean escaped) {
@@ -229,6 +616,7 @@ void builder_widget_connector(
         g_object_get(object, prop, &format, NULL);
         register_widget(GTK_WIDGET(object), paned, prop, format, escaped);
         g_object_set(object, prop, "", NULL);
+        g_free(format);
 
     } else {
         // signals not really supported ; maybe another day
@@ -253,8 +641,111 @@ void builder_widget_connector(
     }
 }
 
+GtkWidget* make_tab_title_ui_full(GtkWidget* paned);
+
+/*
+ * with tab-virtualise, tabs get an empty placeholder label until the notebook
+ * actually shows it (it only maps the labels of tabs in the visible range)
+ * and go back to a placeholder once they have been hidden for a while
+ * so formatters only exist (and update) for tabs that can be seen
+ */
+
+void tab_title_swap(GtkWidget* paned, gboolean placeholder) {
+    GtkWidget* old = g_object_get_data(G_OBJECT(paned), "tab_title");
+    if (! old || ! gtk_widget_get_parent(paned)) return;
+    if (placeholder == GPOINTER_TO_INT(g_object_get_data(G_OBJECT(old), "placeholder"))) return;
+
+    // replaces the tab label and the tab_title
+    GtkWidget* widget = placeholder ? make_tab_placeholder(paned) : make_tab_title_ui_full(paned);
+    if (! widget) return;
+    gtk_widget_destroy(old);
+    g_object_unref(old);
+}
+
+gboolean tab_title_realise(GtkWidget* paned) {
+    tab_title_swap(paned, FALSE);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean tab_title_virtualise(GtkWidget* paned) {
+    g_object_set_data(G_OBJECT(paned), "virtualise-timer", NULL);
+    GtkWidget* ui = g_object_get_data(G_OBJECT(paned), "tab_title");
+    if (ui && ! gtk_widget_get_mapped(ui)) {
+        tab_title_swap(paned, TRUE);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void tab_title_mapped(GtkWidget* widget, GtkWidget* paned) {
+    guint timer = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(paned), "virtualise-timer"));
+    if (timer) {
+        g_source_remove(timer);
+        g_object_set_data(G_OBJECT(paned), "virtualise-timer", NULL);
+    }
+
+    if (g_object_get_data(G_OBJECT(widget), "placeholder")) {
+        // not while the notebook is in the middle of mapping
+        g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, (GSourceFunc)tab_title_realise, g_object_ref(paned), g_object_unref);
+    }
+}
+
+void tab_title_unmapped(GtkWidget* widget, GtkWidget* paned) {
+    if (GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(paned), "virtualise-timer"))) return;
+    guint timer = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, TAB_VIRTUALISE_DELAY, (GSourceFunc)tab_title_virtualise, g_object_ref(paned), g_object_unref);
+    g_object_set_data(G_OBJECT(paned), "virtualise-timer", GUINT_TO_POINTER(timer));
+}
+
+void tab_title_set(GtkWidget* paned, GtkWidget* widget) {
+    // carry over classes from the label being replaced, e.g. active or ones from add_css_class
+    GtkWidget* old = g_object_get_data(G_OBJECT(paned), "tab_title");
+    if (old) {
+        GtkStyleContext* context = gtk_widget_get_style_context(widget);
+        GList* classes = gtk_style_context_list_classes(gtk_widget_get_style_context(old));
+        for (GList* node = classes; node; node = node->next) {
+            gtk_style_context_add_class(context, node->data);
+        }
+        g_list_free(classes);
+    }
+
+    g_object_ref(widget); // tab_title keeps a ref
+    g_object_set_data(G_OBJECT(paned), "tab_title", widget);
+
+    if (tab_virtualise) {
+        g_signal_connect(widget, "map", G_CALLBACK(tab_title_mapped), paned);
+        g_signal_connect(widget, "unmap", G_CALLBACK(tab_title_unmapped), paned);
+    }
+
+    GtkWidget* notebook = gtk_widget_get_parent(paned);
+    if (notebook) {
+        gtk_notebook_set_tab_label(GTK_NOTEBOOK(notebook), paned, widget);
+        notebook_invalidate_tab_sizes(notebook);
+        GtkWidget* terminal = split_get_active_term(paned);
+        if (terminal) {
+            update_tab_titles(VTE_TERMINAL(terminal));
+        }
+        gtk_widget_show_all(widget);
+    }
+}
+
+GtkWidget* make_tab_placeholder(GtkWidget* paned) {
+    GtkWidget* widget = gtk_label_new(NULL);
+    g_object_set_data(G_OBJECT(widget), "placeholder", GINT_TO_POINTER(TRUE));
+    tab_title_set(paned, widget);
+    return widget;
+}
+
 GtkWidget* make_tab_title_ui(GtkWidget* paned) {
     if (! tab_title_ui) return NULL;
+    if (tab_virtualise) return make_tab_placeholder(paned);
+    return make_tab_title_ui_full(paned);
+}
+
+GtkWidget* make_tab_title_ui_full(GtkWidget* paned) {
+    if (title_template) {
+        GtkWidget* widget = title_node_instantiate(title_template, paned);
+        tab_title_set(paned, widget);
+        return widget;
+    }
 
     GtkBuilder* builder = gtk_builder_new();
     GError* error = NULL;
@@ -284,20 +775,9 @@ GtkWidget* make_tab_title_ui(GtkWidget* paned) {
     }
 
     gtk_builder_connect_signals_full(builder, (GtkBuilderConnectFunc)builder_widget_connector, paned);
-    g_object_ref(widget); // ref or builder will destroy it
+    // ref or builder will destroy it
+    tab_title_set(paned, widget);
     g_object_unref(builder);
 
-    g_object_set_data(G_OBJECT(paned), "tab_title", widget);
-
-    GtkWidget* notebook = gtk_widget_get_parent(paned);
-    if (notebook) {
-        gtk_notebook_set_tab_label(GTK_NOTEBOOK(notebook), paned, widget);
-        GtkWidget* terminal = split_get_active_term(paned);
-        if (terminal) {
-            update_tab_titles(VTE_TERMINAL(terminal));
-        }
-        gtk_widget_show_all(widget);
-    }
-
     return widget;
 }
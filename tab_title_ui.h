@@ -9,6 +9,10 @@
 #define TITLE_FORMAT_CWD 3
 #define TITLE_FORMAT_NUM 4
 #define TITLE_FORMAT_USER 5
+#define TITLE_FORMAT_PLUGIN 8
+
+// how long a tab title has to be hidden before it is virtualised
+#define TAB_VIRTUALISE_DELAY 5000
 
 typedef struct {
     int flags;
@@ -16,10 +20,12 @@ typedef struct {
 } TitleFormat;
 
 void update_tab_titles(VteTerminal* terminal);
+int tab_title_formatter_count(GtkWidget* root_split);
 gboolean set_tab_label_format(char* string, PangoEllipsizeMode ellipsize, float xalign);
 gboolean set_tab_title_ui(char* string);
 void destroy_all_tab_title_uis();
 TitleFormat parse_title_format(char* string);
 GtkWidget* make_tab_title_ui(GtkWidget* paned);
+GtkWidget* make_tab_placeholder(GtkWidget* paned);
 
 #endif
@@ -17,6 +17,14 @@
 #include "utils.h"
 #include "tab_title_ui.h"
 #include "search_bar.h"
+#include "regex_cache.h"
+#include "search_count.h"
+#include "recording.h"
+#include "prompt_marks.h"
+#include "plugin.h"
+#include "scheduler.h"
+#include "memory.h"
+#include "ansi.h"
 
 const gint ERROR_EXIT_CODE = 127;
 #define DEFAULT_SHELL "/bin/sh"
@@ -71,6 +79,13 @@ void term_exited(VteTerminal* terminal, gint status, GtkWidget* grid) {
 }
 
 void term_destroyed(VteTerminal* terminal, GtkWidget* grid) {
+    scheduler_forget(terminal);
+    search_count_cancel(terminal);
+    memory_reclaim_later();
+    guint resize_timer = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(terminal), "resize-timer"));
+    if (resize_timer) {
+        g_source_remove(resize_timer);
+    }
     GSource* inactivity_timer = g_object_get_data(G_OBJECT(terminal), "inactivity_timer");
     if (inactivity_timer) {
         g_source_destroy(inactivity_timer);
@@ -87,6 +102,7 @@ void terminal_hyperlink_hover(VteTerminal* terminal) {
     g_object_get(G_OBJECT(terminal), "hyperlink-hover-uri", &uri, NULL);
     if (uri) {
         trigger_action(terminal, EVENT_KEY, HYPERLINK_HOVER_EVENT);
+        g_free(uri);
     }
 }
 
@@ -96,6 +112,7 @@ gboolean terminal_button_press_event(VteTerminal* terminal, GdkEvent* event) {
         g_object_get(G_OBJECT(terminal), "hyperlink-hover-uri", &uri, NULL);
         if (uri) {
             trigger_action(terminal, EVENT_KEY, HYPERLINK_CLICK_EVENT);
+            g_free(uri);
         }
     }
     return FALSE;
@@ -151,38 +168,188 @@ gboolean term_focus_in_event(VteTerminal* terminal, GdkEvent* event, gpointer da
     term_set_focus(terminal, FALSE);
     // clear activity once terminal is focused
     change_terminal_state(terminal, TERMINAL_NO_STATE);
+    // catch up on any deferred output
+    scheduler_flush(terminal);
+    memory_touch(terminal);
 
     trigger_action(terminal, EVENT_KEY, FOCUS_IN_EVENT);
     return FALSE;
 }
 
+gboolean terminal_inactivity(VteTerminal* terminal);
+
+void terminal_start_inactivity_timer(VteTerminal* terminal, int duration) {
+    GSource* inactivity_timer = g_timeout_source_new(duration);
+    g_source_set_callback(inactivity_timer, (GSourceFunc)terminal_inactivity, terminal, NULL);
+    g_object_set_data(G_OBJECT(terminal), "inactivity_timer", inactivity_timer);
+    g_source_attach(inactivity_timer, NULL);
+}
+
 gboolean terminal_inactivity(VteTerminal* terminal) {
+    GSource* inactivity_timer = g_object_get_data(G_OBJECT(terminal), "inactivity_timer");
+    g_object_set_data(G_OBJECT(terminal), "inactivity_timer", NULL);
+    g_source_unref(inactivity_timer);
+
     if (gtk_widget_has_focus(GTK_WIDGET(terminal))) {
         return FALSE;
     }
 
+    // there was more activity since the timer started, wait out the rest
+    gint64 last = *(gint64*)g_object_get_data(G_OBJECT(terminal), "last-activity");
+    gint64 remaining = last + inactivity_duration * 1000L - g_get_monotonic_time();
+    if (remaining > 0) {
+        terminal_start_inactivity_timer(terminal, remaining / 1000 + 1);
+        return FALSE;
+    }
+
     change_terminal_state(terminal, TERMINAL_INACTIVE);
-    g_object_set_data(G_OBJECT(terminal), "inactivity_timer", NULL);
     return FALSE;
 }
 
+void terminal_contents_changed(VteTerminal* terminal) {
+    // lets cached search results etc tell whether they are stale
+    guint generation = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(terminal), "contents-generation"));
+    g_object_set_data(G_OBJECT(terminal), "contents-generation", GUINT_TO_POINTER(generation+1));
+}
+
+typedef struct {
+    // key -> highest row committed so far
+    GHashTable* watermarks;
+    // highest upper row seen on the normal screen
+    glong normal_upper;
+    glong columns;
+} CommittedRows;
+
+void committed_rows_free(CommittedRows* committed) {
+    g_hash_table_unref(committed->watermarks);
+    free(committed);
+}
+
+CommittedRows* term_get_committed(VteTerminal* terminal) {
+    CommittedRows* committed = g_object_get_data(G_OBJECT(terminal), "committed-rows");
+    if (! committed) {
+        committed = calloc(1, sizeof(CommittedRows));
+        committed->watermarks = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+        committed->columns = vte_terminal_get_column_count(terminal);
+        g_object_set_data_full(G_OBJECT(terminal), "committed-rows", committed, (GDestroyNotify)committed_rows_free);
+    }
+    return committed;
+}
+
+void term_reset_committed_rows(VteTerminal* terminal) {
+    // e.g. after the scrollback was cleared and rows are numbered from 0 again
+    g_object_set_data(G_OBJECT(terminal), "committed-rows", NULL);
+}
+
+void term_rebase_committed_rows(CommittedRows* committed, glong cursor_row, glong upper) {
+    // rewrapping renumbers the rows, everything up to the cursor has been seen already
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, committed->watermarks);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        g_hash_table_iter_replace(&iter, GINT_TO_POINTER(cursor_row));
+    }
+    committed->normal_upper = upper;
+}
+
+gboolean term_get_committed_rows(VteTerminal* terminal, const char* key, glong* start, glong* end) {
+    /*
+     * rows completed since the last call with this key
+     * i.e. up to but excluding the cursor row, which may still be written to
+     * returns FALSE if there are none
+     *
+     * the watermark only ever goes up, so rows are never reported twice
+     * when the cursor moves up and back down (progress bars, redraws etc)
+     */
+    CommittedRows* committed = term_get_committed(terminal);
+    glong cursor_row, cursor_col;
+    vte_terminal_get_cursor_position(terminal, &cursor_col, &cursor_row);
+
+    int lower, upper;
+    term_get_row_positions(terminal, NULL, NULL, &lower, &upper);
+
+    glong columns = vte_terminal_get_column_count(terminal);
+    if (columns != committed->columns) {
+        gboolean rewrap;
+        g_object_get(G_OBJECT(terminal), "rewrap-on-resize", &rewrap, NULL);
+        if (rewrap) term_rebase_committed_rows(committed, cursor_row, upper);
+        committed->columns = columns;
+    }
+
+    /*
+     * the alternate screen (vim, less etc) has no scrollback and its rows are numbered
+     * separately, lower than the normal screen, nothing there is committed output
+     */
+    if (upper - lower <= vte_terminal_get_row_count(terminal) && upper < committed->normal_upper) {
+        return FALSE;
+    }
+    committed->normal_upper = upper;
+
+    gpointer value;
+    glong watermark = 0;
+    if (g_hash_table_lookup_extended(committed->watermarks, key, NULL, &value)) {
+        watermark = GPOINTER_TO_INT(value);
+    }
+    // cursor moved up e.g. screen was cleared, nothing new has been committed
+    if (cursor_row <= watermark) return FALSE;
+    // keys may be built on the fly (e.g. pipe_since names), so the table keeps its own copy
+    g_hash_table_insert(committed->watermarks, strdup(key), GINT_TO_POINTER(cursor_row));
+
+    *start = MAX(watermark, lower);
+    *end = cursor_row;
+    return *start < *end;
+}
+
+void terminal_selection_changed(VteTerminal* terminal) {
+    TermSelection* selection = term_get_selection(terminal);
+    // term_select_range fills this in itself
+    if (selection->selecting) return;
+
+    selection->has_bounds = FALSE;
+    // the emptiness check is deferred until someone actually asks
+    selection->empty = vte_terminal_get_has_selection(terminal) ? -1 : TRUE;
+}
+
+gboolean term_selection_is_empty(VteTerminal* terminal) {
+    TermSelection* selection = term_get_selection(terminal);
+    if (selection->empty >= 0) return selection->empty;
+
+    // vte_terminal_get_has_selection is unreliable, it can have empty selections
+    if (! vte_terminal_get_has_selection(terminal)) {
+        selection->empty = TRUE;
+    } else if (selection->has_bounds) {
+        selection->empty = selection->start_row == selection->end_row && selection->start_col == selection->end_col;
+    } else {
+#if VTE_CHECK_VERSION(0, 70, 0)
+        char* text = vte_terminal_get_text_selected(terminal, VTE_FORMAT_TEXT);
+        selection->empty = ! text || ! *text;
+        free(text);
+#else
+        selection->empty = FALSE;
+#endif
+    }
+    return selection->empty;
+}
+
 void terminal_activity(VteTerminal* terminal) {
+    scheduler_count_text_inserted(terminal);
     if (gtk_widget_has_focus(GTK_WIDGET(terminal))) {
         return;
     }
 
     change_terminal_state(terminal, TERMINAL_ACTIVE);
-    GSource* inactivity_timer = g_object_get_data(G_OBJECT(terminal), "inactivity_timer");
 
-    if (inactivity_timer) {
-        g_source_destroy(inactivity_timer);
-        g_source_unref(inactivity_timer);
+    // this runs for every insert, so just note the time rather than restarting the timer
+    gint64* last = g_object_get_data(G_OBJECT(terminal), "last-activity");
+    if (! last) {
+        last = malloc(sizeof(gint64));
+        g_object_set_data_full(G_OBJECT(terminal), "last-activity", last, free);
     }
+    *last = g_get_monotonic_time();
 
-    inactivity_timer = g_timeout_source_new(inactivity_duration);
-    g_source_set_callback(inactivity_timer, (GSourceFunc)terminal_inactivity, terminal, NULL);
-    g_object_set_data(G_OBJECT(terminal), "inactivity_timer", inactivity_timer);
-    g_source_attach(inactivity_timer, NULL);
+    if (! g_object_get_data(G_OBJECT(terminal), "inactivity_timer")) {
+        terminal_start_inactivity_timer(terminal, inactivity_duration);
+    }
 }
 
 
@@ -243,9 +410,9 @@ gboolean term_construct_title(const char* format, int flags, VteTerminal* termin
     if (! format) return FALSE;
 
     // get title
-    char* title = NULL;
-    g_object_get(G_OBJECT(terminal), "window-title", &title, NULL);
-    title = title ? title : "";
+    char* window_title = NULL;
+    g_object_get(G_OBJECT(terminal), "window-title", &window_title, NULL);
+    char* title = window_title ? window_title : "";
 
     char *dir = NULL, *name = NULL;
     char dirbuffer[256] = "";
@@ -282,14 +449,32 @@ gboolean term_construct_title(const char* format, int flags, VteTerminal* termin
         dir = g_markup_escape_text(dir, -1);
     }
 
-    int result = snprintf(buffer, length, format, title, name, dir, tab_number, user) >= 0;
+    // plugin fields
+    char* fields[PLUGIN_MAX_TITLE_FIELDS] = {0};
+    if (flags & TITLE_FORMAT_PLUGIN) {
+        plugin_title_fields(terminal, fields);
+        if (escape_markup) {
+            for (int i = 0; i < PLUGIN_MAX_TITLE_FIELDS; i ++) {
+                char* escaped = g_markup_escape_text(fields[i], -1);
+                free(fields[i]);
+                fields[i] = strdup(escaped);
+                g_free(escaped);
+            }
+        }
+    }
+
+    int result = snprintf(buffer, length, format, title, name, dir, tab_number, user, fields[0], fields[1], fields[2], fields[3]) >= 0;
 
+    for (int i = 0; i < PLUGIN_MAX_TITLE_FIELDS; i ++) {
+        free(fields[i]);
+    }
     freeproc(proc);
     if (escape_markup) {
         g_free(title);
         g_free(name);
         g_free(dir);
     }
+    g_free(window_title);
 
     return result;
 }
@@ -443,16 +628,46 @@ void configure_terminal_scrollbar(VteTerminal* terminal, GtkPolicyType scrollbar
  * 3. draw overlay bg in overlay post draw handler
  */
 
+void overlay_style_updated(GtkWidget* widget) {
+    // recheck the css background on next draw
+    g_object_set_data(G_OBJECT(widget), "has-background", GINT_TO_POINTER(-1));
+}
+
+gboolean overlay_has_background(GtkWidget* widget) {
+    int has_background = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(widget), "has-background"));
+    if (has_background < 0) {
+        GtkStyleContext* context = gtk_widget_get_style_context(widget);
+        GtkStateFlags state = gtk_style_context_get_state(context);
+        GdkRGBA* colour = NULL;
+        cairo_pattern_t* image = NULL;
+        gtk_style_context_get(context, state,
+                GTK_STYLE_PROPERTY_BACKGROUND_COLOR, &colour,
+                GTK_STYLE_PROPERTY_BACKGROUND_IMAGE, &image,
+                NULL);
+        has_background = image || (colour && colour->alpha > 0);
+        if (colour) gdk_rgba_free(colour);
+        if (image) cairo_pattern_destroy(image);
+        g_object_set_data(G_OBJECT(widget), "has-background", GINT_TO_POINTER(has_background));
+    }
+    return has_background;
+}
+
 gboolean draw_overlay_widget_post(GtkWidget* widget, cairo_t* cr, GtkWidget* terminal) {
     /*
      * draw the overlay background on top of everything
      */
 
-    GdkRectangle rect;
-    gtk_widget_get_allocation(widget, &rect);
-    GtkStyleContext* context = gtk_widget_get_style_context(widget);
-    gtk_render_background(context, cr, rect.x, 0, rect.width, rect.height);
+    if (overlay_has_background(widget)) {
+        // cairo is already clipped to the damaged area
+        GdkRectangle rect;
+        gtk_widget_get_allocation(widget, &rect);
+        GtkStyleContext* context = gtk_widget_get_style_context(widget);
+        gtk_render_background(context, cr, rect.x, 0, rect.width, rect.height);
+    }
 
+    if (search_highlight_all) {
+        search_count_draw(VTE_TERMINAL(terminal), widget, cr);
+    }
     return FALSE;
 }
 
@@ -462,15 +677,56 @@ gboolean draw_overlay_widget(GtkWidget* widget, cairo_t* cr, GtkWidget* terminal
      * since this draw handler gets called first
      */
 
-    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
-    cairo_set_source_rgba(cr, BACKGROUND.red, BACKGROUND.green, BACKGROUND.blue, BACKGROUND.alpha);
-    cairo_paint(cr);
+    if (BACKGROUND.alpha > 0) {
+        cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+        cairo_set_source_rgba(cr, BACKGROUND.red, BACKGROUND.green, BACKGROUND.blue, BACKGROUND.alpha);
+        cairo_paint(cr);
+    }
     return FALSE;
 }
 
+gboolean term_resize_settled(VteTerminal* terminal) {
+    g_object_set_data(G_OBJECT(terminal), "resize-timer", NULL);
+    // let the real width through, so vte rewraps (and the child gets SIGWINCH) just the once
+    g_object_set_data(G_OBJECT(terminal), "resize-settled", GINT_TO_POINTER(TRUE));
+    gtk_widget_queue_resize(GTK_WIDGET(terminal));
+    return G_SOURCE_REMOVE;
+}
+
+gboolean term_live_resize(VteTerminal* terminal) {
+    /*
+     * while the size keeps changing (e.g. dragging a window edge or split handle)
+     * keep the width (and so the columns) from before the drag, then apply the final width once it settles
+     * returns TRUE while the width is being held back
+     */
+    if (! terminal_rewrap_on_resize || rewrap_resize_delay <= 0) return FALSE;
+
+    guint timer = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(terminal), "resize-timer"));
+    if (timer) {
+        g_source_remove(timer);
+    }
+    timer = g_timeout_add(rewrap_resize_delay, (GSourceFunc)term_resize_settled, terminal);
+    g_object_set_data(G_OBJECT(terminal), "resize-timer", GUINT_TO_POINTER(timer));
+    return TRUE;
+}
+
 gboolean overlay_position_term(GtkWidget* overlay, GtkWidget* widget, GdkRectangle* rect) {
     if (VTE_IS_TERMINAL(widget)) {
         gtk_widget_get_allocation(overlay, rect);
+
+        // width changes are what cause a rewrap
+        GtkAllocation current;
+        gtk_widget_get_allocation(widget, &current);
+        gboolean settled = g_object_steal_data(G_OBJECT(widget), "resize-settled") != NULL;
+        if (gtk_widget_get_mapped(widget) && current.width > 1 && current.width != rect->width) {
+            if (! settled && term_live_resize(VTE_TERMINAL(widget))) {
+                rect->width = current.width;
+            } else {
+                // rewrapping renumbers the rows, so catch up on deferred output first
+                scheduler_flush(VTE_TERMINAL(widget));
+            }
+        }
+
         int min, natural;
         gtk_widget_get_preferred_height(widget, &min, &natural);
 
@@ -536,6 +792,8 @@ void term_select_range(VteTerminal* terminal, double start_col, double start_row
     start_row += lower;
     end_row += lower;
 
+    TermSelection* selection = term_get_selection(terminal);
+
     /* have to find the right GdkWindow or the terminal won't accept the events */
     GdkWindow* window = gtk_widget_get_window(GTK_WIDGET(terminal));
     GdkDisplay* display = gdk_window_get_display(window);
@@ -550,6 +808,8 @@ void term_select_range(VteTerminal* terminal, double start_col, double start_row
         return;
     }
 
+    selection->selecting = TRUE;
+
     // restore focus to this widget afterwards
     GtkWidget* focused = gtk_window_get_focus(GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(terminal))));
     if (! focused) focused = GTK_WIDGET(terminal);
@@ -612,6 +872,14 @@ void term_select_range(VteTerminal* terminal, double start_col, double start_row
     button.y = (end_row-value)*height;
     GTK_WIDGET_GET_CLASS(terminal)->button_release_event(GTK_WIDGET(terminal), &button);
 
+    selection->selecting = FALSE;
+    selection->has_bounds = ! double_click;
+    selection->start_col = start_col;
+    selection->start_row = start_row;
+    selection->end_col = end_col;
+    selection->end_row = end_row;
+    selection->empty = vte_terminal_get_has_selection(terminal) ? -1 : TRUE;
+
     /* scroll back to original if possible */
     if (original < end_row && original+page_size >= start_row) {
         gtk_adjustment_set_value(adjustment, original);
@@ -655,113 +923,68 @@ char* term_get_text(VteTerminal* terminal, glong start_row, glong start_col, glo
 
     char* text = vte_terminal_get_text_range(terminal, start_row, start_col, end_row, end_col, NULL, NULL, attrs);
     if (ansi) {
-        GArray* output = g_array_new(TRUE, TRUE, sizeof(char));
-        VteCharAttributes prev = { 0,0, {0,0,0}, {0,0,0}, 0, 0 };
-        char buf[32];
-
-        const char* c;
-        for (c = text; *c; c++) {
-            VteCharAttributes a = g_array_index(attrs, VteCharAttributes, c - text);
-            /* no bold or italic */
-
-            // foreground
-            if (c == text || a.fore.red != prev.fore.red || a.fore.green != prev.fore.green || a.fore.blue != prev.fore.blue) {
-                int n = sprintf(buf, "\x1b[38;2;%i;%i;%im", a.fore.red>>8, a.fore.green>>8, a.fore.blue>>8);
-                g_array_append_vals(output, buf, n);
-            }
-            // background
-            if (c == text || a.back.red != prev.back.red || a.back.green != prev.back.green || a.back.blue != prev.back.blue) {
-                int n = sprintf(buf, "\x1b[48;2;%i;%i;%im", a.back.red>>8, a.back.green>>8, a.back.blue>>8);
-                g_array_append_vals(output, buf, n);
-            }
-            // underline
-            if (c == text || a.underline != prev.underline) {
-                g_array_append_vals(output, a.underline ? "\x1b[4m" : "\x1b[24m", a.underline ? 4 : 5);
-            }
-            g_array_append_val(output, *c);
-            prev = a;
-        }
-
+        // vte does not expose bold/italic, so fg, bg, underline and strikethrough is all we can do
+        char* output = text ? ansi_serialize(text, attrs) : NULL;
         free(text);
-        text = output->data;
-        g_array_free(output, FALSE);
+        text = output;
         g_array_free(attrs, TRUE);
     }
 
     return text;
 }
 
-gboolean term_search(VteTerminal* terminal, const char* data, int direction) {
-    // return TRUE if match found
+guint32 search_pattern_flags(const char* pattern) {
+    guint32 flags = PCRE2_MULTILINE | PCRE2_CASELESS;
+    switch (search_case_sensitive) {
+        case REGEX_CASE_SENSITIVE:
+            flags &= ~PCRE2_CASELESS; break;
+        case REGEX_CASE_SMART:
+            for (const char* c = pattern; *c; c++) {
+                // backslashes only escape things in regex patterns
+                if (search_use_regex && *c == '\\' && *(c+1)) c++;
+                else if (g_ascii_isupper(*c)) {
+                    flags &= ~PCRE2_CASELESS;
+                    break;
+                }
+            }
+    }
+    return flags;
+}
+
+VteRegex* term_search_set_pattern(VteTerminal* terminal, const char* data) {
+    // set the search pattern without actually searching
+    // returns the regex or NULL if no/invalid pattern
 
     char* old = g_object_get_data(G_OBJECT(terminal), "search-pattern");
     if (data && STR_EQUAL(data, "")) data = NULL;
 
-    if (old == NULL && data == NULL) return FALSE;
-
-    char* pattern = NULL;
-    if (search_use_regex && data) {
-        pattern = strdup(data);
-    } else if (data) {
-        pattern = g_regex_escape_string(data, -1);
-    }
-
-    gboolean pattern_changed = !old || !pattern || !STR_EQUAL(old, pattern);
-
-    int flags = PCRE2_MULTILINE | PCRE2_CASELESS;
-    if (pattern) {
-        switch (search_case_sensitive) {
-            case REGEX_CASE_SENSITIVE:
-                flags &= ~PCRE2_CASELESS; break;
-            case REGEX_CASE_SMART:
-                for (const char* c = pattern; pattern && *c; c++) {
-                    if (*c == '\\' && *(c+1)) c++;
-                    else if (g_ascii_isupper(*c)) {
-                        flags &= ~PCRE2_CASELESS;
-                        break;
-                    }
-                }
-        }
-    }
+    if (old == NULL && data == NULL) return NULL;
 
-    VteRegex* old_regex = vte_terminal_search_get_regex(terminal);
+    // compiled regexes are shared between terminals
     VteRegex* regex = NULL;
-    gboolean flags_changed = (flags != GPOINTER_TO_INT(g_object_get_data(G_OBJECT(terminal), "flags")));
-
-    if (pattern_changed || flags_changed) {
-        if (pattern) {
-            GError* error = NULL;
-            regex = vte_regex_new_for_search(pattern, -1, flags, &error);
-            if (error) {
-                g_warning("%s: %s", error->message, pattern);
-                g_error_free(error);
-                return FALSE;
-            }
-        }
+    if (data) {
+        regex = regex_cache_lookup(data, search_pattern_flags(data), search_use_regex);
+        if (! regex) return NULL;
+    }
 
-        g_object_set_data(G_OBJECT(terminal), "search-pattern", pattern);
-        g_object_set_data(G_OBJECT(terminal), "flags", GINT_TO_POINTER(flags));
+    if (! old || ! data || ! STR_EQUAL(old, data)) {
+        g_object_set_data_full(G_OBJECT(terminal), "search-pattern", data ? strdup(data) : NULL, free);
+    }
+    if (regex != vte_terminal_search_get_regex(terminal)) {
         vte_terminal_search_set_regex(terminal, regex, 0);
-        free(old);
-
-    } else {
-        regex = old_regex;
     }
+    return regex;
+}
 
-    if (! regex) return FALSE;
+gboolean term_search(VteTerminal* terminal, const char* data, int direction) {
+    // return TRUE if match found
 
+    if (! term_search_set_pattern(terminal, data)) return FALSE;
 
     int start, end, max, min;
     term_get_row_positions(terminal, &start, &end, &min, &max);
 
-    // vte_terminal_get_has_selection is unreliable, it can have empty selections
-    AtkText* text = ATK_TEXT(gtk_widget_get_accessible(GTK_WIDGET(terminal)));
-    char* selected = atk_text_get_selection(text, 0, NULL, NULL);
-    if (selected && STR_EQUAL(selected, "")) {
-        free(selected);
-        selected = NULL;
-    }
-    free(selected);
+    gboolean selected = ! term_selection_is_empty(terminal);
 
     // next/down = 1, previous/up = -1
     if (direction > 0) {
@@ -846,6 +1069,12 @@ GtkWidget* make_terminal_full(const char* cwd, int argc, char** argv, GSpawnChil
     configure_terminal(VTE_TERMINAL(terminal));
     g_object_set(terminal, "expand", TRUE, "scrollback-lines", terminal_default_scrollback_lines, NULL);
     g_object_set_data(G_OBJECT(terminal), "activity_state", GINT_TO_POINTER(TERMINAL_NO_STATE));
+    // stable across moving tabs/windows
+    static guint next_id = 0;
+    g_object_set_data(G_OBJECT(terminal), "id", GUINT_TO_POINTER(++next_id));
+    TermSelection* selection = calloc(1, sizeof(TermSelection));
+    selection->empty = TRUE;
+    g_object_set_data_full(G_OBJECT(terminal), "selection", selection, free);
     vte_terminal_set_clear_background(VTE_TERMINAL(terminal), FALSE);
 
     g_signal_connect(terminal, "focus-in-event", G_CALLBACK(term_focus_in_event), NULL);
@@ -853,10 +1082,20 @@ GtkWidget* make_terminal_full(const char* cwd, int argc, char** argv, GSpawnChil
     g_signal_connect(terminal, "destroy", G_CALLBACK(term_destroyed), grid);
     g_signal_connect(terminal, "window-title-changed", G_CALLBACK(update_tab_titles), NULL);
     g_signal_connect(terminal, "text-inserted", G_CALLBACK(terminal_activity), NULL);
+    g_signal_connect(terminal, "contents-changed", G_CALLBACK(terminal_contents_changed), NULL);
+    // output_match and scrollback_log handlers, deferred for background terminals
+    g_signal_connect(terminal, "contents-changed", G_CALLBACK(scheduler_contents_changed), NULL);
+    g_signal_connect(terminal, "contents-changed", G_CALLBACK(memory_contents_changed), NULL);
+    g_signal_connect(terminal, "notify::scrollback-lines", G_CALLBACK(memory_scrollback_lines_changed), NULL);
+    g_signal_connect(terminal, "contents-changed", G_CALLBACK(recording_contents_changed), NULL);
+    prompt_marks_init(VTE_TERMINAL(terminal));
+    g_signal_connect(terminal, "selection-changed", G_CALLBACK(terminal_selection_changed), NULL);
     g_signal_connect(terminal, "bell", G_CALLBACK(terminal_bell), NULL);
     g_signal_connect(terminal, "hyperlink-hover-uri-changed", G_CALLBACK(terminal_hyperlink_hover), NULL);
     g_signal_connect(terminal, "button-press-event", G_CALLBACK(terminal_button_press_event), NULL);
     g_signal_connect(overlay, "draw", G_CALLBACK(draw_overlay_widget), terminal);
+    g_signal_connect(overlay, "style-updated", G_CALLBACK(overlay_style_updated), NULL);
+    overlay_style_updated(overlay);
 
     g_signal_connect_after(overlay, "draw", G_CALLBACK(draw_overlay_widget_post), terminal);
     gtk_widget_set_app_paintable(overlay, TRUE);
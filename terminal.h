@@ -5,8 +5,18 @@
 #include <termios.h>
 #include <proc/readproc.h>
 
+#define term_get_id(terminal) GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(terminal), "id"))
 #define get_pid(terminal) GPOINTER_TO_INT(g_object_get_data(G_OBJECT(terminal), "pid"))
 
+typedef struct {
+    // -1 if not worked out yet
+    int empty;
+    // only known for selections made through term_select_range, absolute rows
+    gboolean has_bounds;
+    double start_col, start_row, end_col, end_row;
+    gboolean selecting;
+} TermSelection;
+
 void term_setup_pipes(int pipes[2]);
 GtkWidget* make_terminal(const char* cwd, int argc, char** argv);
 GtkWidget* make_terminal_full(const char* cwd, int argc, char** argv, GSpawnChildSetupFunc child_setup, void* child_setup_data, GDestroyNotify child_setup_destroy);
@@ -29,8 +39,15 @@ GtkWidget* term_get_tab(VteTerminal* terminal);
 #define term_get_window(terminal) gtk_widget_get_toplevel(GTK_WIDGET(terminal))
 GtkWidget* term_remove(VteTerminal* terminal);
 void term_select_range(VteTerminal* terminal, double start_col, double start_row, double end_col, double end_row, int modifiers, gboolean double_click);
+#define term_get_selection(terminal) ((TermSelection*)g_object_get_data(G_OBJECT(terminal), "selection"))
+gboolean term_selection_is_empty(VteTerminal* terminal);
 void term_get_row_positions(VteTerminal* terminal, int* screen_lower, int* screen_upper, int* lower, int* upper);
+gboolean term_get_committed_rows(VteTerminal* terminal, const char* key, glong* start, glong* end);
+void term_reset_committed_rows(VteTerminal* terminal);
 char* term_get_text(VteTerminal* terminal, glong start_row, glong start_col, glong end_row, glong end_col, gboolean ansi);
+guint32 search_pattern_flags(const char* pattern);
+VteRegex* term_search_set_pattern(VteTerminal* terminal, const char* data);
 gboolean term_search(VteTerminal* terminal, const char* data, int direction);
+#define term_get_contents_generation(terminal) GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(terminal), "contents-generation"))
 
 #endif
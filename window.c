@@ -6,6 +6,8 @@
 #include "tab_title_ui.h"
 #include "split.h"
 #include "utils.h"
+#include "worker.h"
+#include "memory.h"
 
 GList* toplevel_windows = NULL;
 
@@ -64,6 +66,18 @@ gint get_tab_number(VteTerminal* terminal) {
     return gtk_notebook_page_num(notebook, tab);
 }
 
+typedef struct {
+    // last computed tab size and what it was computed from
+    int size;
+    int n;
+    gboolean vertical;
+    // border + padding + margin of the notebook
+    gboolean style_valid;
+    GtkStateFlags state;
+    int horizontal_extra;
+    int vertical_extra;
+} TabSizeCache;
+
 void notebook_size_allocate(GtkNotebook* notebook, GdkRectangle* alloc) {
     GtkPositionType pos = gtk_notebook_get_tab_pos(notebook);
     gboolean vertical = (pos == GTK_POS_LEFT || pos == GTK_POS_RIGHT);
@@ -97,33 +111,54 @@ void notebook_size_allocate(GtkNotebook* notebook, GdkRectangle* alloc) {
     if (n == 0) return;
 
     GtkStateFlags state = gtk_widget_get_state_flags(GTK_WIDGET(notebook));
-    GtkStyleContext* style = gtk_widget_get_style_context(GTK_WIDGET(notebook));
-    GtkBorder border, padding, margin;
-    gtk_style_context_get_border(style, state, &border);
-    gtk_style_context_get_padding(style, state, &padding);
-    gtk_style_context_get_margin(style, state, &margin);
+    TabSizeCache* cache = g_object_get_data(G_OBJECT(notebook), "tab-size-cache");
+    if (! cache->style_valid || cache->state != state) {
+        GtkStyleContext* style = gtk_widget_get_style_context(GTK_WIDGET(notebook));
+        GtkBorder border, padding, margin;
+        gtk_style_context_get_border(style, state, &border);
+        gtk_style_context_get_padding(style, state, &padding);
+        gtk_style_context_get_margin(style, state, &margin);
+        cache->horizontal_extra = border.left + padding.left + margin.left + border.right + padding.right + margin.right;
+        cache->vertical_extra = border.top + padding.top + margin.top + border.bottom + padding.bottom + margin.bottom;
+        cache->state = state;
+        cache->style_valid = TRUE;
+        cache->size = -1;
+    }
 
-    width -= border.left + padding.left + margin.left + border.right + padding.right + margin.right;
-    height -= border.top + padding.top + margin.top + border.bottom + padding.bottom + margin.bottom;
+    int size = vertical ? height - cache->vertical_extra : width - cache->horizontal_extra;
+    // nothing has changed since last time
+    if (cache->size == size && cache->n == n && cache->vertical == vertical) return;
+    cache->size = size;
+    cache->n = n;
+    cache->vertical = vertical;
 
     // resize tab titles to be all the same size
+    double value = ((double)size) / n;
     for (int i = 0; i < n; i ++) {
         GtkWidget* page = gtk_notebook_get_nth_page(notebook, i);
         GtkWidget* label = gtk_notebook_get_tab_label(notebook, page);
         if (label) {
-            double value;
-            if (vertical) {
-                value = ((double)height) / n;
-                gtk_widget_set_size_request(label, -1, (int)(value*(i+1)) - (int)(value*i));
-            } else {
-                value = ((double)width) / n;
-                gtk_widget_set_size_request(label, (int)(value*(i+1)) - (int)(value*i), -1);
+            int new_size = (int)(value*(i+1)) - (int)(value*i);
+            int old_width, old_height;
+            gtk_widget_get_size_request(label, &old_width, &old_height);
+            // only touch labels that actually change, each one queues a resize
+            if (vertical && (old_width != -1 || old_height != new_size)) {
+                gtk_widget_set_size_request(label, -1, new_size);
+            } else if (! vertical && (old_width != new_size || old_height != -1)) {
+                gtk_widget_set_size_request(label, new_size, -1);
             }
         }
     }
 }
 
+void notebook_invalidate_tab_sizes(GtkWidget* notebook) {
+    // e.g. style changed, tabs reordered or tab labels replaced
+    TabSizeCache* cache = g_object_get_data(G_OBJECT(notebook), "tab-size-cache");
+    cache->style_valid = FALSE;
+}
+
 void notebook_tab_removed(GtkWidget* notebook, GtkWidget *child, guint page_num) {
+    memory_reclaim_later();
     if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) == 0) {
         gtk_widget_destroy(gtk_widget_get_toplevel(notebook));
     } else {
@@ -193,6 +228,7 @@ gboolean window_focus_event(GtkWindow* window) {
     // move to start of list
     toplevel_windows = g_list_remove(toplevel_windows, window);
     toplevel_windows = g_list_prepend(toplevel_windows, window);
+    worker_report_focus();
     return FALSE;
 }
 
@@ -285,7 +321,12 @@ GtkWidget* make_window() {
 
     gtk_notebook_set_show_border(GTK_NOTEBOOK(notebook), FALSE);
     g_signal_connect(notebook, "focus-in-event", G_CALLBACK(notebook_focus_event), window);
+    TabSizeCache* tab_size_cache = calloc(1, sizeof(TabSizeCache));
+    tab_size_cache->size = -1;
+    g_object_set_data_full(G_OBJECT(notebook), "tab-size-cache", tab_size_cache, free);
     g_signal_connect(notebook, "size-allocate", G_CALLBACK(notebook_size_allocate), NULL);
+    g_signal_connect(notebook, "style-updated", G_CALLBACK(notebook_invalidate_tab_sizes), NULL);
+    g_signal_connect(notebook, "page-reordered", G_CALLBACK(notebook_invalidate_tab_sizes), NULL);
     g_signal_connect(notebook, "page-removed", G_CALLBACK(notebook_tab_removed), NULL);
     g_signal_connect(notebook, "create-window", G_CALLBACK(notebook_create_window), NULL);
     g_signal_connect(notebook, "switch-page", G_CALLBACK(notebook_switch_page), NULL);
@@ -16,6 +16,7 @@ void add_tab_to_window(GtkWidget*, GtkWidget*, int);
 gboolean prevent_tab_close(VteTerminal*);
 void refresh_ui_window(GtkWidget* window);
 void refresh_ui_notebook(GtkWidget* notebook);
+void notebook_invalidate_tab_sizes(GtkWidget* notebook);
 
 #define FOREACH_WINDOW(var) \
     for (GList* _l = toplevel_windows; _l; _l = _l->next) \
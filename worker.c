@@ -0,0 +1,553 @@
+#include <gtk/gtk.h>
+#include <glib-unix.h>
+#include <gio/gunixfdmessage.h>
+#include <errno.h>
+#include <signal.h>
+#include "worker.h"
+#include "server.h"
+#include "config.h"
+#include "window.h"
+#include "action.h"
+#include "utils.h"
+
+/*
+ * multi-process mode (worker-processes > 0)
+ *
+ * the process that owns the app socket becomes a coordinator with no windows of its own
+ * windows live in worker processes, each listening on its own socket (<app id>.worker<N>)
+ * and each with its own main loop, so heavy output in one worker cannot stall the others
+ *
+ * the coordinator forwards socket commands:
+ *      @N:command          to worker N
+ *      new_window          to a new worker until there are worker-processes of them,
+ *                          then round robin
+ *      other actions       to the worker with the most recently focused window
+ *      anything else       (i.e. config) to every worker
+ *      workers             is answered by the coordinator itself
+ * forwarding is asynchronous so one stuck worker cannot hold up the others,
+ * a worker that does not reply in time gets an empty reply sent on its behalf
+ *
+ * terminals inherit the worker socket as TERMINEUR_ID,
+ * so commands run from inside a terminal go straight to the owning worker
+ */
+
+typedef struct {
+    int index;
+    GPid pid;
+    char* id;
+} Worker;
+
+int worker_index = -1;
+gboolean is_coordinator = FALSE;
+char* coordinator_id = NULL;
+// only set in the coordinator
+GList* workers = NULL;
+Worker* current_worker = NULL;
+int next_worker_index = 0;
+guint round_robin = 0;
+
+Worker* worker_find(int index) {
+    for (GList* node = workers; node; node = node->next) {
+        if (((Worker*)node->data)->index == index) {
+            return node->data;
+        }
+    }
+    return NULL;
+}
+
+void worker_exited(GPid pid, gint status, Worker* worker) {
+    g_spawn_close_pid(pid);
+    workers = g_list_remove(workers, worker);
+    if (current_worker == worker) {
+        current_worker = workers ? workers->data : NULL;
+    }
+    free(worker->id);
+    free(worker);
+
+    if (! workers) {
+        gtk_main_quit();
+    }
+}
+
+Worker* worker_spawn(int argc, char** argv, const char* command) {
+    Worker* worker = malloc(sizeof(Worker));
+    worker->index = next_worker_index ++;
+    worker->id = g_strdup_printf("%s.worker%i", app_id, worker->index);
+
+    char index[32];
+    snprintf(index, sizeof(index), "%i", worker->index);
+    char** env = g_get_environ();
+    env = g_environ_setenv(env, APP_PREFIX "_ID", worker->id, TRUE);
+    env = g_environ_setenv(env, WORKER_ENV, index, TRUE);
+    env = g_environ_setenv(env, WORKER_COORDINATOR_ENV, app_id, TRUE);
+    if (command) {
+        env = g_environ_setenv(env, WORKER_COMMAND_ENV, command, TRUE);
+    }
+
+    char* args[argc + 5];
+    int n = 0;
+    args[n++] = app_path;
+    if (config_filename) {
+        args[n++] = "-C";
+        args[n++] = config_filename;
+    }
+    args[n++] = "--";
+    for (int i = 0; i < argc; i ++) {
+        args[n++] = argv[i];
+    }
+    args[n] = NULL;
+
+    GError* error = NULL;
+    gboolean success = g_spawn_async(NULL, args, env, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &worker->pid, &error);
+    g_strfreev(env);
+
+    if (! success) {
+        g_warning("Failed to spawn worker: %s", error->message);
+        g_error_free(error);
+        free(worker->id);
+        free(worker);
+        return NULL;
+    }
+
+    workers = g_list_append(workers, worker);
+    if (! current_worker) {
+        current_worker = worker;
+    }
+    g_child_watch_add(worker->pid, (GChildWatchFunc)worker_exited, worker);
+    return worker;
+}
+
+typedef struct {
+    int index;
+    GSocket* sock;
+    GSocketAddress* addr;
+    gint64 deadline;
+    WorkerConnectFunc callback;
+    gpointer data;
+} WorkerConnect;
+
+gboolean worker_connect_step(WorkerConnect* attempt);
+
+void worker_connect_finish(WorkerConnect* attempt, gboolean success) {
+    g_object_unref(attempt->addr);
+    if (success) {
+        // only the connect is non blocking, lines and replies are small
+        g_socket_set_blocking(attempt->sock, TRUE);
+    } else if (attempt->sock) {
+        close_socket(attempt->sock);
+        attempt->sock = NULL;
+    }
+    attempt->callback(attempt->sock, attempt->data);
+    free(attempt);
+}
+
+void worker_connect_retry(WorkerConnect* attempt, GError* error) {
+    // the worker may still be starting up
+    if (g_get_monotonic_time() > attempt->deadline) {
+        g_warning("Failed to connect to worker %i: %s", attempt->index, error->message);
+        worker_connect_finish(attempt, FALSE);
+    } else {
+        g_timeout_add(WORKER_CONNECT_RETRY_INTERVAL, (GSourceFunc)worker_connect_step, attempt);
+    }
+}
+
+gboolean worker_connect_pending(GSocket* sock, GIOCondition io, WorkerConnect* attempt) {
+    GError* error = NULL;
+    if (g_socket_check_connect_result(sock, &error)) {
+        worker_connect_finish(attempt, TRUE);
+    } else {
+        worker_connect_retry(attempt, error);
+        g_error_free(error);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+gboolean worker_connect_step(WorkerConnect* attempt) {
+    GError* error = NULL;
+    if (! attempt->sock) {
+        worker_connect_finish(attempt, FALSE);
+
+    } else if (g_socket_connect(attempt->sock, attempt->addr, NULL, &error)) {
+        worker_connect_finish(attempt, TRUE);
+
+    } else if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_PENDING)) {
+        GSource* source = g_socket_create_source(attempt->sock, G_IO_OUT | G_IO_ERR | G_IO_HUP, NULL);
+        g_source_set_callback(source, (GSourceFunc)worker_connect_pending, attempt, NULL);
+        g_source_attach(source, NULL);
+        g_source_unref(source);
+        g_error_free(error);
+
+    } else {
+        worker_connect_retry(attempt, error);
+        g_error_free(error);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void worker_connect(Worker* worker, WorkerConnectFunc callback, gpointer data) {
+    /*
+     * callback gets the connected socket, or NULL on failure,
+     * always later from the main loop so nothing waits on a worker that is starting up or stuck
+     */
+    WorkerConnect* attempt = malloc(sizeof(WorkerConnect));
+    attempt->index = worker->index;
+    attempt->deadline = g_get_monotonic_time() + WORKER_CONNECT_TIMEOUT * 1000;
+    attempt->callback = callback;
+    attempt->data = data;
+    if (make_sock(worker->id, &attempt->sock, &attempt->addr)) {
+        g_socket_set_blocking(attempt->sock, FALSE);
+    } else {
+        attempt->sock = NULL;
+    }
+    g_idle_add((GSourceFunc)worker_connect_step, attempt);
+}
+
+typedef struct {
+    int index;
+    char* line;
+    gboolean want_fd;
+    WorkerReplyFunc callback;
+    gpointer data;
+
+    GSocket* sock;
+    GSource* source;
+    guint timeout;
+    Buffer* buffer;
+    int fd;
+} WorkerRequest;
+
+void worker_request_finish(WorkerRequest* request) {
+    if (request->source) {
+        g_source_destroy(request->source);
+        g_source_unref(request->source);
+    }
+    if (request->timeout) g_source_remove(request->timeout);
+    if (request->sock) close_socket(request->sock);
+
+    char* result = request->buffer && request->buffer->used > 0 && request->buffer->data[0] ? strdup(request->buffer->data) : NULL;
+    if (request->fd >= 0 && ! request->want_fd) {
+        close(request->fd);
+        request->fd = -1;
+    }
+    request->callback(result, request->fd, request->data);
+
+    if (request->buffer) buffer_free(request->buffer);
+    free(request->line);
+    free(request);
+}
+
+gboolean worker_request_timeout(WorkerRequest* request) {
+    // give up, the worker is stuck or busy
+    g_warning("Worker %i did not reply within %ims", request->index, WORKER_REPLY_TIMEOUT);
+    request->timeout = 0;
+    if (request->buffer) request->buffer->used = 0;
+    worker_request_finish(request);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean worker_request_recv(GSocket* sock, GIOCondition io, WorkerRequest* request) {
+    // read the reply, keeping hold of any fd passed along with it
+    Buffer* buffer = request->buffer;
+    if (buffer->reserved - buffer->used < BUFFER_DEFAULT_SIZE) {
+        buffer_reserve(buffer, buffer->reserved+BUFFER_DEFAULT_SIZE);
+    }
+
+    GError* error = NULL;
+    GInputVector vector = {buffer->data + buffer->used, BUFFER_DEFAULT_SIZE};
+    GSocketControlMessage** messages = NULL;
+    int nmessages = 0;
+    int len = g_socket_receive_message(sock, NULL, &vector, 1, &messages, &nmessages, NULL, NULL, &error);
+
+    sock_take_fds(messages, nmessages, &request->fd);
+
+    if (len < 0) {
+        g_warning("Failed to recv() from worker %i: %s", request->index, error->message);
+        g_error_free(error);
+        buffer->used = 0;
+    } else if (len == 0) {
+        g_warning("Unexpected EOF from worker %i", request->index);
+        buffer->used = 0;
+    } else {
+        buffer->used += len;
+        if (! memchr(buffer->data + buffer->used - len, 0, len)) {
+            return G_SOURCE_CONTINUE;
+        }
+    }
+
+    worker_request_finish(request);
+    return G_SOURCE_REMOVE;
+}
+
+void worker_request_connected(GSocket* sock, WorkerRequest* request) {
+    // sock_send_all closes the socket on failure
+    if (! sock || ! sock_send_all(sock, request->line, strlen(request->line)+1)) {
+        worker_request_finish(request);
+        return;
+    }
+
+    request->sock = sock;
+    request->buffer = buffer_new(0);
+    request->source = g_socket_create_source(sock, G_IO_IN | G_IO_ERR | G_IO_HUP, NULL);
+    g_source_set_callback(request->source, (GSourceFunc)worker_request_recv, request, NULL);
+    g_source_attach(request->source, NULL);
+    request->timeout = g_timeout_add(WORKER_REPLY_TIMEOUT, (GSourceFunc)worker_request_timeout, request);
+}
+
+void worker_send_line(Worker* worker, char* line, int size, gboolean want_fd, WorkerReplyFunc callback, gpointer data) {
+    // callback always gets called later, with a NULL result if the worker did not reply
+    WorkerRequest* request = calloc(1, sizeof(WorkerRequest));
+    request->index = worker->index;
+    request->line = strndup(line, size);
+    request->want_fd = want_fd;
+    request->callback = callback;
+    request->data = data;
+    request->fd = -1;
+    worker_connect(worker, (WorkerConnectFunc)worker_request_connected, request);
+}
+
+void worker_discard_reply(char* result, int fd, gpointer data) {
+    free(result);
+    if (fd >= 0) close(fd);
+}
+
+Worker* worker_pick(char* command) {
+    // spawn if there is room for another worker, otherwise round robin
+    // when spawned, the worker runs the command itself
+    if (command && g_list_length(workers) < worker_processes) {
+        worker_spawn(0, NULL, command);
+        return NULL;
+    }
+    if (! workers) return NULL;
+    return g_list_nth_data(workers, (round_robin ++) % g_list_length(workers));
+}
+
+gboolean is_new_window_line(char* line) {
+    char* copy = strdup(line);
+    Action action = lookup_action(copy);
+    free(copy);
+    gboolean result = action.func == (ActionFunc)new_window;
+    free_action(&action);
+    return result;
+}
+
+char* coordinator_execute_line(char* line, int size, int* fd, WorkerReplyFunc callback, gpointer data, gboolean* deferred) {
+    /*
+     * anything forwarded to a worker is answered later through callback and *deferred is set,
+     * the coordinator never waits on a worker itself
+     */
+    char* result = NULL;
+    char* copy = strndup(line, size);
+    char* command = g_strstrip(copy);
+    *fd = -1;
+    *deferred = FALSE;
+    if (! callback) callback = worker_discard_reply;
+
+    Worker* forward = NULL;
+    if (command[0] == '@') {
+        // explicit worker
+        char* end;
+        int index = strtol(command+1, &end, 10);
+        forward = end != command+1 && *end == ':' ? worker_find(index) : NULL;
+        if (forward) {
+            command = end+1;
+        } else {
+            g_warning("Invalid worker: %s", command);
+        }
+
+    } else if (STR_EQUAL(command, "workers")) {
+        GString* string = g_string_new("");
+        for (GList* node = workers; node; node = node->next) {
+            Worker* worker = node->data;
+            g_string_append_printf(string, "%i\t%i\t%s%s\n", worker->index, worker->pid, worker->id, worker == current_worker ? "\t*" : "");
+        }
+        result = g_string_free(string, FALSE);
+
+    } else if (g_str_has_prefix(command, WORKER_FOCUS_COMMAND)) {
+        Worker* worker = worker_find(atoi(command + sizeof(WORKER_FOCUS_COMMAND)-1));
+        if (worker) current_worker = worker;
+
+    } else if (is_new_window_line(command)) {
+        forward = worker_pick(command);
+
+    } else {
+        char* action_copy = strdup(command);
+        Action action = lookup_action(action_copy);
+        free(action_copy);
+
+        if (action.func) {
+            free_action(&action);
+            forward = current_worker;
+        } else {
+            // config, apply it everywhere (all at once) but only answer for the current worker
+            for (GList* node = workers; node; node = node->next) {
+                if (node->data != current_worker) {
+                    worker_send_line(node->data, command, strlen(command), FALSE, worker_discard_reply, NULL);
+                }
+            }
+            forward = current_worker;
+        }
+    }
+
+    if (forward) {
+        worker_send_line(forward, command, strlen(command), TRUE, callback, data);
+        *deferred = TRUE;
+    }
+
+    free(copy);
+    return result;
+}
+
+typedef struct {
+    GSocket* from;
+    GSocket* to;
+} ProxyData;
+
+void proxy_data_free(ProxyData* proxy) {
+    g_object_unref(proxy->from);
+    g_object_unref(proxy->to);
+    free(proxy);
+}
+
+gboolean proxy_socket(GSocket* sock, GIOCondition io, ProxyData* proxy) {
+    if (io & G_IO_IN) {
+        GError* error = NULL;
+        char buffer[BUFFER_DEFAULT_SIZE];
+        int len = g_socket_receive(proxy->from, buffer, sizeof(buffer), NULL, &error);
+        if (len < 0) {
+            g_warning("Failed to recv(): %s", error->message);
+            g_error_free(error);
+        } else if (len > 0) {
+            for (int sent = 0; sent < len; ) {
+                int result = g_socket_send(proxy->to, buffer + sent, len - sent, NULL, &error);
+                if (result < 0) {
+                    // other end is gone
+                    g_error_free(error);
+                    shutdown_socket(proxy->from, TRUE, FALSE);
+                    return G_SOURCE_REMOVE;
+                }
+                sent += result;
+            }
+            return G_SOURCE_CONTINUE;
+        }
+    }
+
+    // eof or error, pass it on
+    shutdown_socket(proxy->to, FALSE, TRUE);
+    return G_SOURCE_REMOVE;
+}
+
+void proxy_sockets(GSocket* from, GSocket* to) {
+    ProxyData* proxy = malloc(sizeof(ProxyData));
+    proxy->from = g_object_ref(from);
+    proxy->to = g_object_ref(to);
+    GSource* source = g_socket_create_source(from, G_IO_IN | G_IO_ERR | G_IO_HUP, NULL);
+    g_source_set_callback(source, (GSourceFunc)proxy_socket, proxy, (GDestroyNotify)proxy_data_free);
+    g_source_attach(source, NULL);
+    g_source_unref(source);
+}
+
+typedef struct {
+    GSocket* sock;
+    char* value;
+    Buffer* remainder;
+} PipeConnect;
+
+void coordinator_pipe_connected(GSocket* upstream, PipeConnect* pipe) {
+    GSocket* sock = pipe->sock;
+    if (
+            ! upstream
+            || ! sock_send_all(upstream, CONNECT_SOCK, sizeof(CONNECT_SOCK)-1)
+            || ! sock_send_all(upstream, pipe->value, strlen(pipe->value)+1)
+            || (pipe->remainder->used && ! sock_send_all(upstream, pipe->remainder->data, pipe->remainder->used))
+    ) {
+        close_socket(sock);
+    } else {
+        proxy_sockets(sock, upstream);
+        proxy_sockets(upstream, sock);
+        // the proxies own them now
+        g_object_unref(upstream);
+        g_object_unref(sock);
+    }
+
+    free(pipe->value);
+    buffer_free(pipe->remainder);
+    free(pipe);
+}
+
+void coordinator_pipe_over_socket(GSocket* sock, char* value, Buffer* remainder) {
+    // value is the flags then the action, see server_pipe_over_socket
+    Worker* worker = strlen(value) >= 2 && is_new_window_line(value+2) ? worker_pick(NULL) : current_worker;
+    if (! worker) {
+        close_socket(sock);
+        return;
+    }
+
+    // the caller frees these once we return
+    PipeConnect* pipe = malloc(sizeof(PipeConnect));
+    pipe->sock = sock;
+    pipe->value = strdup(value);
+    pipe->remainder = buffer_new(remainder->used);
+    memcpy(pipe->remainder->data, remainder->data, remainder->used);
+    pipe->remainder->used = remainder->used;
+    worker_connect(worker, (WorkerConnectFunc)coordinator_pipe_connected, pipe);
+}
+
+int run_coordinator(int argc, char** argv) {
+    is_coordinator = TRUE;
+    if (! worker_spawn(argc, argv, NULL)) {
+        return 1;
+    }
+
+    g_unix_signal_add(SIGINT, (GSourceFunc)gtk_main_quit, NULL);
+    gtk_main();
+
+    // take the workers down with us
+    for (GList* node = workers; node; node = node->next) {
+        kill(((Worker*)node->data)->pid, SIGTERM);
+    }
+    return 0;
+}
+
+GtkWidget* worker_init(int argc, char** argv) {
+    const char* index = g_getenv(WORKER_ENV);
+    if (index) {
+        worker_index = atoi(index);
+        coordinator_id = g_strdup(g_getenv(WORKER_COORDINATOR_ENV));
+        char* command = g_strdup(g_getenv(WORKER_COMMAND_ENV));
+        // don't leak these into terminals
+        g_unsetenv(WORKER_ENV);
+        g_unsetenv(WORKER_COORDINATOR_ENV);
+        g_unsetenv(WORKER_COMMAND_ENV);
+
+        if (command) {
+            // started for a new window
+            Action action = lookup_action(command);
+            GtkWidget* widget = NULL;
+            if (action.func == (ActionFunc)new_window && (widget = new_window(NULL, action.data, NULL))) {
+                widget = gtk_widget_get_toplevel(widget);
+            }
+            free_action(&action);
+            g_free(command);
+            if (widget) return widget;
+        }
+    }
+
+    return make_new_window_full(NULL, NULL, argc, argv);
+}
+
+void worker_report_focus() {
+    if (worker_index < 0 || ! coordinator_id) return;
+
+    GSocket* sock;
+    GSocketAddress* addr;
+    if (! make_sock(coordinator_id, &sock, &addr)) return;
+
+    char line[64];
+    int len = snprintf(line, sizeof(line), WORKER_FOCUS_COMMAND "%i", worker_index);
+    // no reply is sent, so this never waits on the coordinator
+    // (which may itself be waiting on us)
+    if (! g_socket_connect(sock, addr, NULL, NULL) || sock_send_all(sock, line, len+1)) {
+        close_socket(sock);
+    }
+    g_object_unref(addr);
+}
@@ -0,0 +1,31 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <gtk/gtk.h>
+#include "socket.h"
+#include "config.h"
+
+#define WORKER_ENV APP_PREFIX "_WORKER"
+#define WORKER_COORDINATOR_ENV APP_PREFIX "_COORDINATOR"
+#define WORKER_COMMAND_ENV APP_PREFIX "_WORKER_COMMAND"
+#define WORKER_FOCUS_COMMAND "worker_focus:"
+// how long to wait for a new worker to start listening
+#define WORKER_CONNECT_TIMEOUT 5000
+#define WORKER_CONNECT_RETRY_INTERVAL 10
+// how long to wait for a worker to answer before giving up on it
+#define WORKER_REPLY_TIMEOUT 10000
+
+typedef void(*WorkerConnectFunc)(GSocket* sock, gpointer data);
+typedef void(*WorkerReplyFunc)(char* result, int fd, gpointer data);
+
+// index of this process if it is a worker, -1 otherwise
+int worker_index;
+gboolean is_coordinator;
+
+int run_coordinator(int argc, char** argv);
+GtkWidget* worker_init(int argc, char** argv);
+void worker_report_focus();
+char* coordinator_execute_line(char* line, int size, int* fd, WorkerReplyFunc callback, gpointer data, gboolean* deferred);
+void coordinator_pipe_over_socket(GSocket* sock, char* value, Buffer* remainder);
+
+#endif